@@ -0,0 +1,114 @@
+#pragma once
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <variant>
+#include <vector>
+
+#include "BVH.hpp"
+#include "Grid.hpp"
+#include "VecUtils.hpp"
+
+// Stand-in for the callbacks Traverse takes, only used to spell out the Accelerator concept
+struct PrimitiveCallback
+{
+	bool operator()(uint32_t Primitive, float& TMax) const;
+};
+
+// What a top level acceleration structure has to provide; it only ever sees one box per primitive
+// Traverse calls IntersectPrimitive(Index, TMax) for candidate primitives along a ray, which shrinks TMax
+// on a hit and returns true to stop early; see BVH::Traverse
+template <typename T>
+concept Accelerator = requires(T Structure, const T& ConstStructure, const std::vector<AABB>& PrimitiveBounds, const vec3& Vector, float& TMax)
+{
+	Structure.Build(PrimitiveBounds);
+	Structure.Refit(PrimitiveBounds);
+	{ Structure.Update(PrimitiveBounds) } -> std::same_as<bool>;
+	{ ConstStructure.MemoryUsage() } -> std::convertible_to<size_t>;
+	ConstStructure.Traverse(Vector, Vector, 0.0f, TMax, PrimitiveCallback());
+};
+
+// Tests every primitive against every ray; the baseline the real structures are measured against
+class LinearScan
+{
+public:
+	void Build(const std::vector<AABB>& PrimitiveBounds)
+	{
+		Primitives = static_cast<uint32_t>(PrimitiveBounds.size());
+		SceneBounds = AABB();
+		for (const AABB& Bounds : PrimitiveBounds)
+			SceneBounds.Grow(Bounds);
+	}
+
+	void Refit(const std::vector<AABB>& PrimitiveBounds) { Build(PrimitiveBounds); }
+
+	bool Update(const std::vector<AABB>& PrimitiveBounds)
+	{
+		Build(PrimitiveBounds);
+		return true;
+	}
+
+	bool Empty() const { return Primitives == 0; }
+	size_t PrimitiveCount() const { return Primitives; }
+	size_t MemoryUsage() const { return 0; }
+	const AABB& Bounds() const { return SceneBounds; }
+
+	template <typename Fn>
+	void Traverse(const vec3& Origin, const vec3& InvDirection, float TMin, float& TMax, Fn&& IntersectPrimitive) const
+	{
+		if (SceneBounds.Intersect(Origin, InvDirection, TMin, TMax) == std::numeric_limits<float>::max())
+			return;
+		for (uint32_t i = 0; i < Primitives; i++)
+		{
+			if (IntersectPrimitive(i, TMax))
+				return;
+		}
+	}
+
+private:
+	uint32_t Primitives = 0;
+	AABB SceneBounds{};
+};
+
+static_assert(Accelerator<LinearScan> && Accelerator<BVH> && Accelerator<UniformGrid>);
+
+// Which structure the scene's top level is built as; in the same order as AnyAccelerator
+enum class AcceleratorType
+{
+	Linear,
+	BVH,
+	Grid
+};
+
+// Runtime choice between the structures; code that visits it gets a copy specialized for each
+using AnyAccelerator = std::variant<LinearScan, BVH, UniformGrid>;
+
+namespace Acceleration
+{
+	// Offers every candidate primitive to IntersectPrimitive(Index, TMax), which narrows TMax and returns true on a hit
+	// Returns whether anything was hit; TMax ends up at the closest hit
+	template <Accelerator T, typename Fn>
+	bool ClosestHit(const T& Structure, const vec3& Origin, const vec3& InvDirection, float TMin, float& TMax, Fn&& IntersectPrimitive)
+	{
+		bool Hit = false;
+		Structure.Traverse(Origin, InvDirection, TMin, TMax, [&](uint32_t Primitive, float& ClosestT)
+		{
+			Hit |= IntersectPrimitive(Primitive, ClosestT);
+			return false;
+		});
+		return Hit;
+	}
+
+	// Same as ClosestHit, but stops at the first hit, wherever it is; meant for shadow rays
+	template <Accelerator T, typename Fn>
+	bool AnyHit(const T& Structure, const vec3& Origin, const vec3& InvDirection, float TMin, float TMax, Fn&& IntersectPrimitive)
+	{
+		bool Hit = false;
+		Structure.Traverse(Origin, InvDirection, TMin, TMax, [&](uint32_t Primitive, float& ClosestT)
+		{
+			Hit = IntersectPrimitive(Primitive, ClosestT);
+			return Hit;
+		});
+		return Hit;
+	}
+}
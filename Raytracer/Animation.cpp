@@ -0,0 +1,50 @@
+#include "Animation.hpp"
+#include "Raytracer.hpp"
+
+float Animation::EndTime() const
+{
+	// Every keyframe sets all of an object's tracks, so one track each says when it ends
+	float End = Camera.Position.EndTime();
+	for (const SphereAnimation& Keys : Spheres)
+		End = std::max(End, Keys.Origin.EndTime());
+	for (const LightAnimation& Keys : Lights)
+		End = std::max(End, Keys.Intensity.EndTime());
+	for (const InstanceAnimation& Keys : Instances)
+		End = std::max(End, Keys.Position.EndTime());
+	return End;
+}
+
+void Animation::Apply(float Time, Scene& Scene) const
+{
+	if (!Camera.Position.Empty())
+	{
+		Scene.Camera.Position = Camera.Position.Evaluate(Time);
+		Scene.Camera.Yaw = Camera.Yaw.Evaluate(Time);
+		Scene.Camera.Pitch = Camera.Pitch.Evaluate(Time);
+		Scene.Camera.FieldOfView = Camera.FieldOfView.Evaluate(Time);
+	}
+
+	for (const SphereAnimation& Keys : Spheres)
+	{
+		Sphere& s = Scene.Spheres[Keys.Index];
+		s.Origin = Keys.Origin.Evaluate(Time);
+		s.Radius = Keys.Radius.Evaluate(Time);
+	}
+
+	for (const LightAnimation& Keys : Lights)
+	{
+		Light& l = Scene.Lights[Keys.Index];
+		l.Intensity = Keys.Intensity.Evaluate(Time);
+		if (l.Type == LightType::Point)
+			l.Position = Keys.Vector.Evaluate(Time);
+		else if (l.Type == LightType::Directional)
+			l.Direction = Keys.Vector.Evaluate(Time);
+	}
+
+	for (const InstanceAnimation& Keys : Instances)
+	{
+		MeshInstance& Instance = Scene.Instances[Keys.Index];
+		Instance.ObjectToWorld = Transform::Place(Keys.Position.Evaluate(Time), Keys.Rotation.Evaluate(Time), Keys.Scale.Evaluate(Time));
+		Instance.WorldToObject = Instance.ObjectToWorld.Inverse();
+	}
+}
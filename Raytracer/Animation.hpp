@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "VecUtils.hpp"
+
+struct Scene;
+
+// A value set at keyframes and interpolated linearly in between; it holds still before the first keyframe and
+// after the last
+template <typename T>
+class Track
+{
+public:
+	// Replaces the keyframe at the same time, if there is one
+	void Add(float Time, const T& Value)
+	{
+		auto Next = std::lower_bound(Keys.begin(), Keys.end(), Time, [](const Keyframe& Key, float t) { return Key.Time < t; });
+		if (Next != Keys.end() && Next->Time == Time)
+			Next->Value = Value;
+		else
+			Keys.insert(Next, { Time, Value });
+	}
+
+	bool Empty() const { return Keys.empty(); }
+	float EndTime() const { return Keys.empty() ? 0.0f : Keys.back().Time; }
+
+	// Expects at least one keyframe
+	T Evaluate(float Time) const
+	{
+		auto Next = std::lower_bound(Keys.begin(), Keys.end(), Time, [](const Keyframe& Key, float t) { return Key.Time < t; });
+		if (Next == Keys.begin())
+			return Keys.front().Value;
+		if (Next == Keys.end())
+			return Keys.back().Value;
+		const Keyframe& Previous = *(Next - 1);
+		const float Blend = (Time - Previous.Time) / (Next->Time - Previous.Time);
+		return Previous.Value + (Next->Value - Previous.Value) * Blend;
+	}
+
+private:
+	struct Keyframe
+	{
+		float Time;
+		T Value;
+	};
+	std::vector<Keyframe> Keys{};
+};
+
+// Keyframes for one object each, by index into the scene's list of them; every keyframe sets all of an object's
+// tracks, the same values its statement in a scene file takes
+struct SphereAnimation
+{
+	uint32_t Index = 0;
+	Track<vec3> Origin{};
+	Track<float> Radius{};
+};
+
+struct LightAnimation
+{
+	uint32_t Index = 0;
+	Track<float> Intensity{};
+	// Position of point lights, direction of directional lights; unused for ambient lights
+	Track<vec3> Vector{};
+};
+
+struct InstanceAnimation
+{
+	uint32_t Index = 0;
+	// Placed like Transform::Place
+	Track<vec3> Position{};
+	Track<vec3> Rotation{};
+	Track<float> Scale{};
+};
+
+struct CameraAnimation
+{
+	Track<vec3> Position{};
+	Track<float> Yaw{};
+	Track<float> Pitch{};
+	Track<float> FieldOfView{};
+};
+
+// Everything in a scene that moves, and how many frames it takes; times are in seconds
+struct Animation
+{
+	int FrameCount = 1;
+	float FramesPerSecond = 24.0f;
+
+	CameraAnimation Camera{};
+	std::vector<SphereAnimation> Spheres{};
+	std::vector<LightAnimation> Lights{};
+	std::vector<InstanceAnimation> Instances{};
+
+	bool Empty() const
+	{
+		return Camera.Position.Empty() && Spheres.empty() && Lights.empty() && Instances.empty();
+	}
+
+	// Whether anything besides the camera moves, which reprojecting earlier frames can't follow
+	bool MovesObjects() const
+	{
+		return !Spheres.empty() || !Lights.empty() || !Instances.empty();
+	}
+
+	float FrameTime(int Frame) const { return Frame / FramesPerSecond; }
+	float Duration() const { return FrameCount / FramesPerSecond; }
+	// Time of the last keyframe of anything, 0 without any
+	float EndTime() const;
+
+	// Moves everything with keyframes in Scene to where it is at Time and leaves the rest alone; the scene needs
+	// UpdateAcceleration afterwards
+	void Apply(float Time, Scene& Scene) const;
+};
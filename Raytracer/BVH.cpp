@@ -0,0 +1,463 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <future>
+#include <numeric>
+
+#include "BVH.hpp"
+#include "Parallel.hpp"
+
+namespace {
+	constexpr int BIN_COUNT = 16;
+	// Nodes with at least this many primitives are processed across threads, and their subtrees built as separate tasks
+	constexpr uint32_t PARALLEL_THRESHOLD = 1 << 14;
+
+	// Shared by every task of a single build
+	struct BuildContext
+	{
+		std::vector<BVHNode>& Nodes;
+		std::vector<uint32_t>& PrimitiveIndices;
+		const std::vector<AABB>& PrimitiveBounds;
+		std::vector<vec3> Centroids{};
+		// Fast builds only; sorted along with PrimitiveIndices
+		std::vector<uint32_t> MortonCodes{};
+		// Nodes is sized for the worst case up front, so tasks can claim nodes without locking
+		std::atomic<uint32_t> NodeCount{ 1 };
+		// Subtrees are only spawned as tasks above this depth, which roughly matches tasks to threads
+		int TaskDepth = 0;
+	};
+
+	// Builds both children of a node, in parallel if the node is large and near the root
+	template <typename Fn>
+	void BuildChildren(BuildContext& Context, uint32_t Count, int Depth, Fn&& BuildChild)
+	{
+		if (Count >= PARALLEL_THRESHOLD && Depth < Context.TaskDepth)
+		{
+			auto Left = std::async(std::launch::async, [&] { BuildChild(0); });
+			BuildChild(1);
+			Left.get();
+		}
+		else
+		{
+			BuildChild(0);
+			BuildChild(1);
+		}
+	}
+
+	// Turns a node into an interior node whose children split its primitives at Middle
+	uint32_t SplitNode(BuildContext& Context, BVHNode& Node, uint32_t Middle)
+	{
+		const uint32_t Left = Context.NodeCount.fetch_add(2);
+		Context.Nodes[Left] = { AABB(), Node.LeftOrFirst, Middle - Node.LeftOrFirst };
+		Context.Nodes[Left + 1] = { AABB(), Middle, Node.LeftOrFirst + Node.Count - Middle };
+		Node.LeftOrFirst = Left;
+		Node.Count = 0;
+		return Left;
+	}
+
+	struct Bin
+	{
+		AABB Bounds;
+		uint32_t Count = 0;
+	};
+
+	// One set of bins per axis
+	struct BinGrid
+	{
+		Bin Bins[3][BIN_COUNT];
+
+		void Merge(const BinGrid& Other)
+		{
+			for (int Axis = 0; Axis < 3; Axis++)
+			{
+				for (int b = 0; b < BIN_COUNT; b++)
+				{
+					Bins[Axis][b].Bounds.Grow(Other.Bins[Axis][b].Bounds);
+					Bins[Axis][b].Count += Other.Bins[Axis][b].Count;
+				}
+			}
+		}
+	};
+
+	// Grows the node and centroid bounds over Count primitives
+	void ComputeBounds(const BuildContext& Context, const uint32_t* First, size_t Count, AABB& Bounds, AABB& CentroidBounds)
+	{
+		for (size_t i = 0; i < Count; i++)
+		{
+			Bounds.Grow(Context.PrimitiveBounds[First[i]]);
+			CentroidBounds.Grow(Context.Centroids[First[i]]);
+		}
+	}
+
+	// Bins Count primitives by centroid along all three axes
+	void FillBins(const BuildContext& Context, const uint32_t* First, size_t Count, const AABB& CentroidBounds, BinGrid& Grid)
+	{
+		const vec3 Extent = CentroidBounds.Max - CentroidBounds.Min;
+		for (size_t i = 0; i < Count; i++)
+		{
+			const uint32_t Primitive = First[i];
+			const vec3& Centroid = Context.Centroids[Primitive];
+			for (int Axis = 0; Axis < 3; Axis++)
+			{
+				if (Extent[Axis] <= 0.0f)
+					continue;
+				int b = static_cast<int>((Centroid[Axis] - CentroidBounds.Min[Axis]) * (BIN_COUNT / Extent[Axis]));
+				b = std::min(b, BIN_COUNT - 1);
+				Grid.Bins[Axis][b].Bounds.Grow(Context.PrimitiveBounds[Primitive]);
+				Grid.Bins[Axis][b].Count++;
+			}
+		}
+	}
+
+	void BuildBinnedSAH(BuildContext& Context, uint32_t NodeIndex, int Depth)
+	{
+		BVHNode& Node = Context.Nodes[NodeIndex];
+		uint32_t* First = Context.PrimitiveIndices.data() + Node.LeftOrFirst;
+		uint32_t* Last = First + Node.Count;
+
+		// Big nodes are reduced across threads, then the per thread results merged
+		AABB CentroidBounds;
+		BinGrid Grid;
+		if (Node.Count < PARALLEL_THRESHOLD)
+		{
+			ComputeBounds(Context, First, Node.Count, Node.Bounds, CentroidBounds);
+			if (Node.Count <= BVH::MAX_LEAF_SIZE)
+				return;
+			FillBins(Context, First, Node.Count, CentroidBounds, Grid);
+		}
+		else
+		{
+			const size_t Ranges = Parallel::RangeCount(Node.Count, PARALLEL_THRESHOLD / 4);
+			std::vector<AABB> RangeBounds(Ranges * 2);
+			Parallel::ForRanges(Node.Count, Ranges, [&](size_t Begin, size_t End, size_t Range)
+			{
+				ComputeBounds(Context, First + Begin, End - Begin, RangeBounds[Range * 2], RangeBounds[Range * 2 + 1]);
+			});
+			for (size_t Range = 0; Range < Ranges; Range++)
+			{
+				Node.Bounds.Grow(RangeBounds[Range * 2]);
+				CentroidBounds.Grow(RangeBounds[Range * 2 + 1]);
+			}
+
+			std::vector<BinGrid> RangeGrids(Ranges);
+			Parallel::ForRanges(Node.Count, Ranges, [&](size_t Begin, size_t End, size_t Range)
+			{
+				FillBins(Context, First + Begin, End - Begin, CentroidBounds, RangeGrids[Range]);
+			});
+			for (const BinGrid& RangeGrid : RangeGrids)
+				Grid.Merge(RangeGrid);
+		}
+		const Bin (&Bins)[3][BIN_COUNT] = Grid.Bins;
+
+		// Sweep every plane between bins; the cost of a split is each side's area times its primitive count
+		float BestCost = std::numeric_limits<float>::max();
+		int BestAxis = -1;
+		int BestBin = 0;
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			float LeftCosts[BIN_COUNT - 1];
+			AABB LeftBounds;
+			uint32_t LeftCount = 0;
+			for (int b = 0; b < BIN_COUNT - 1; b++)
+			{
+				LeftBounds.Grow(Bins[Axis][b].Bounds);
+				LeftCount += Bins[Axis][b].Count;
+				LeftCosts[b] = LeftBounds.SurfaceArea() * LeftCount;
+			}
+
+			AABB RightBounds;
+			uint32_t RightCount = 0;
+			for (int b = BIN_COUNT - 1; b > 0; b--)
+			{
+				RightBounds.Grow(Bins[Axis][b].Bounds);
+				RightCount += Bins[Axis][b].Count;
+				if (RightCount == 0 || RightCount == Node.Count)
+					continue;
+				const float Cost = LeftCosts[b - 1] + RightBounds.SurfaceArea() * RightCount;
+				if (Cost < BestCost)
+				{
+					BestCost = Cost;
+					BestAxis = Axis;
+					BestBin = b;
+				}
+			}
+		}
+
+		uint32_t* Middle = First;
+		if (BestAxis >= 0 && Depth < BVH::MAX_DEPTH / 2)
+		{
+			const float Min = CentroidBounds.Min[BestAxis];
+			const float Scale = BIN_COUNT / (CentroidBounds.Max[BestAxis] - Min);
+			Middle = std::partition(First, Last, [&](uint32_t Primitive)
+			{
+				return std::min(static_cast<int>((Context.Centroids[Primitive][BestAxis] - Min) * Scale), BIN_COUNT - 1) < BestBin;
+			});
+		}
+
+		// Fall back to a median split when all centroids coincide, or if the tree is getting too deep
+		if (Middle == First || Middle == Last)
+		{
+			const vec3 Extent = CentroidBounds.Max - CentroidBounds.Min;
+			const int Axis = Extent.x > Extent.y ? (Extent.x > Extent.z ? 0 : 2) : (Extent.y > Extent.z ? 1 : 2);
+			Middle = First + Node.Count / 2;
+			std::nth_element(First, Middle, Last, [&](uint32_t a, uint32_t b) { return Context.Centroids[a][Axis] < Context.Centroids[b][Axis]; });
+		}
+
+		const uint32_t Count = Node.Count;
+		const uint32_t Left = SplitNode(Context, Node, static_cast<uint32_t>(Middle - Context.PrimitiveIndices.data()));
+		BuildChildren(Context, Count, Depth, [&](uint32_t Child) { BuildBinnedSAH(Context, Left + Child, Depth + 1); });
+	}
+
+	// Spreads the lower 10 bits of v out so there are two zero bits between each of them
+	uint32_t ExpandBits(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	// 30 bit Morton code of a point inside Bounds
+	uint32_t MortonCode(const vec3& Point, const AABB& Bounds)
+	{
+		uint32_t Code = 0;
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			const float Extent = Bounds.Max[Axis] - Bounds.Min[Axis];
+			const float Normalized = Extent > 0.0f ? (Point[Axis] - Bounds.Min[Axis]) / Extent : 0.0f;
+			const uint32_t Quantized = static_cast<uint32_t>(std::clamp(Normalized * 1024.0f, 0.0f, 1023.0f));
+			Code |= ExpandBits(Quantized) << (2 - Axis);
+		}
+		return Code;
+	}
+
+	// Splits each node where the highest differing bit of its sorted Morton codes flips, then fits bounds on the way back up
+	void BuildLinear(BuildContext& Context, uint32_t NodeIndex, int Depth)
+	{
+		BVHNode& Node = Context.Nodes[NodeIndex];
+		if (Node.Count <= BVH::MAX_LEAF_SIZE)
+		{
+			for (uint32_t i = Node.LeftOrFirst; i < Node.LeftOrFirst + Node.Count; i++)
+				Node.Bounds.Grow(Context.PrimitiveBounds[Context.PrimitiveIndices[i]]);
+			return;
+		}
+
+		const uint32_t* Codes = Context.MortonCodes.data();
+		const uint32_t First = Node.LeftOrFirst;
+		const uint32_t Last = First + Node.Count;
+		const uint32_t Differing = Codes[First] ^ Codes[Last - 1];
+
+		uint32_t Middle = First + Node.Count / 2;
+		if (Differing != 0)
+		{
+			const uint32_t Bit = 1u << (31 - std::countl_zero(Differing));
+			Middle = static_cast<uint32_t>(std::partition_point(Codes + First, Codes + Last, [Bit](uint32_t Code) { return (Code & Bit) == 0; }) - Codes);
+		}
+
+		const uint32_t Count = Node.Count;
+		const uint32_t Left = SplitNode(Context, Node, Middle);
+		BuildChildren(Context, Count, Depth, [&](uint32_t Child) { BuildLinear(Context, Left + Child, Depth + 1); });
+		Node.Bounds.Grow(Context.Nodes[Left].Bounds);
+		Node.Bounds.Grow(Context.Nodes[Left + 1].Bounds);
+	}
+
+	// Fits the node's grid to Bounds and stores each child's box on it, rounded outwards
+	void Quantize(WideBVHNode& Node, const AABB& Bounds, const AABB* ChildBounds)
+	{
+		Node.Origin = Bounds.Min;
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			// Smallest power of two grid whose 255 steps still reach the far side of the box
+			const float Extent = Bounds.Max[Axis] - Bounds.Min[Axis];
+			int Exponent = Extent > 0.0f ? std::clamp(static_cast<int>(std::ceil(std::log2(Extent / 255.0f))), -126, 127) : -126;
+			while (Exponent < 127 && Node.Origin[Axis] + 255.0f * std::ldexp(1.0f, Exponent) < Bounds.Max[Axis])
+				Exponent++;
+			Node.Exponent[Axis] = static_cast<int8_t>(Exponent);
+
+			const float Scale = Node.Scale(Axis);
+			for (int i = 0; i < Node.ChildCount; i++)
+			{
+				const float Min = ChildBounds[i].Min[Axis];
+				const float Max = ChildBounds[i].Max[Axis];
+				int Low = std::clamp(static_cast<int>(std::floor((Min - Node.Origin[Axis]) / Scale)), 0, 255);
+				int High = std::clamp(static_cast<int>(std::ceil((Max - Node.Origin[Axis]) / Scale)), 0, 255);
+				while (Low > 0 && Node.Origin[Axis] + Low * Scale > Min)
+					Low--;
+				while (High < 255 && Node.Origin[Axis] + High * Scale < Max)
+					High++;
+				Node.QuantizedMin[Axis][i] = static_cast<uint8_t>(Low);
+				Node.QuantizedMax[Axis][i] = static_cast<uint8_t>(High);
+			}
+		}
+	}
+}
+
+void BVH::Build(const std::vector<AABB>& PrimitiveBounds, BVHBuildQuality Quality)
+{
+	const size_t Count = PrimitiveBounds.size();
+	Nodes.clear();
+	PrimitiveIndices.resize(Count);
+	std::iota(PrimitiveIndices.begin(), PrimitiveIndices.end(), 0);
+	RootBounds = AABB();
+	BuildCost = 0.0f;
+	if (Count == 0)
+		return;
+
+	// A binary tree with N leaves never has more than 2N - 1 nodes
+	std::vector<BVHNode> BinaryNodes(Count * 2);
+	BinaryNodes[0] = { AABB(), 0, static_cast<uint32_t>(Count) };
+
+	BuildContext Context{ BinaryNodes, PrimitiveIndices, PrimitiveBounds };
+	Context.TaskDepth = std::bit_width(Parallel::ThreadCount()) + 1;
+	Context.Centroids.resize(Count);
+	Parallel::For(Count, [&](size_t i) { Context.Centroids[i] = PrimitiveBounds[i].Centroid(); });
+
+	if (Quality == BVHBuildQuality::High)
+	{
+		BuildBinnedSAH(Context, 0, 0);
+	}
+	else
+	{
+		AABB CentroidBounds;
+		for (const vec3& Centroid : Context.Centroids)
+			CentroidBounds.Grow(Centroid);
+
+		Context.MortonCodes.resize(Count);
+		Parallel::For(Count, [&](size_t i) { Context.MortonCodes[i] = MortonCode(Context.Centroids[i], CentroidBounds); });
+		Parallel::RadixSort(Context.MortonCodes, PrimitiveIndices, 30);
+		BuildLinear(Context, 0, 0);
+	}
+
+	// Every wide node replaces at least one binary interior node, of which there are fewer than half
+	RootBounds = BinaryNodes[0].Bounds;
+	Nodes.reserve(Context.NodeCount / 2 + 1);
+	Nodes.emplace_back();
+	Collapse(BinaryNodes, 0, 0);
+	Nodes.shrink_to_fit();
+	BuildCost = Cost();
+}
+
+void BVH::Collapse(const std::vector<BVHNode>& BinaryNodes, uint32_t BinaryIndex, uint32_t WideIndex)
+{
+	// Start from the binary node's children, then keep opening the largest interior child until the node is full
+	// A tree that is a single leaf gets a root with just that leaf
+	uint32_t Children[WideBVHNode::WIDTH] = { BinaryIndex };
+	int ChildCount = 1;
+	if (!BinaryNodes[BinaryIndex].IsLeaf())
+	{
+		Children[0] = BinaryNodes[BinaryIndex].LeftOrFirst;
+		Children[1] = BinaryNodes[BinaryIndex].LeftOrFirst + 1;
+		ChildCount = 2;
+	}
+	while (ChildCount < WideBVHNode::WIDTH)
+	{
+		int Largest = -1;
+		float LargestArea = -1.0f;
+		for (int i = 0; i < ChildCount; i++)
+		{
+			const BVHNode& Child = BinaryNodes[Children[i]];
+			if (!Child.IsLeaf() && Child.Bounds.SurfaceArea() > LargestArea)
+			{
+				Largest = i;
+				LargestArea = Child.Bounds.SurfaceArea();
+			}
+		}
+		if (Largest < 0)
+			break;
+		const uint32_t Opened = BinaryNodes[Children[Largest]].LeftOrFirst;
+		Children[Largest] = Opened;
+		Children[ChildCount++] = Opened + 1;
+	}
+
+	AABB ChildBounds[WideBVHNode::WIDTH];
+	WideBVHNode Node;
+	Node.ChildCount = static_cast<uint8_t>(ChildCount);
+	for (int i = 0; i < ChildCount; i++)
+	{
+		const BVHNode& Child = BinaryNodes[Children[i]];
+		ChildBounds[i] = Child.Bounds;
+		if (Child.IsLeaf())
+		{
+			Node.Child[i] = Child.LeftOrFirst;
+			Node.PrimitiveCount[i] = static_cast<uint8_t>(Child.Count);
+		}
+		else
+		{
+			Node.Child[i] = static_cast<uint32_t>(Nodes.size());
+			Nodes.emplace_back();
+		}
+	}
+	Quantize(Node, BinaryNodes[BinaryIndex].Bounds, ChildBounds);
+	Nodes[WideIndex] = Node;
+
+	for (int i = 0; i < ChildCount; i++)
+	{
+		if (Node.PrimitiveCount[i] == 0)
+			Collapse(BinaryNodes, Children[i], Node.Child[i]);
+	}
+}
+
+void BVH::Refit(const std::vector<AABB>& PrimitiveBounds)
+{
+	if (!Nodes.empty())
+		RootBounds = RefitNode(0, PrimitiveBounds);
+}
+
+AABB BVH::RefitNode(uint32_t Index, const std::vector<AABB>& PrimitiveBounds)
+{
+	WideBVHNode& Node = Nodes[Index];
+	AABB ChildBounds[WideBVHNode::WIDTH];
+	AABB Bounds;
+	for (int i = 0; i < Node.ChildCount; i++)
+	{
+		if (Node.PrimitiveCount[i] == 0)
+		{
+			ChildBounds[i] = RefitNode(Node.Child[i], PrimitiveBounds);
+		}
+		else
+		{
+			for (uint32_t p = Node.Child[i]; p < Node.Child[i] + Node.PrimitiveCount[i]; p++)
+				ChildBounds[i].Grow(PrimitiveBounds[PrimitiveIndices[p]]);
+		}
+		Bounds.Grow(ChildBounds[i]);
+	}
+	Quantize(Node, Bounds, ChildBounds);
+	return Bounds;
+}
+
+bool BVH::Update(const std::vector<AABB>& PrimitiveBounds, BVHBuildQuality Quality)
+{
+	if (Nodes.empty() || PrimitiveBounds.size() != PrimitiveIndices.size())
+	{
+		Build(PrimitiveBounds, Quality);
+		return true;
+	}
+
+	Refit(PrimitiveBounds);
+	if (Cost() > BuildCost * REBUILD_THRESHOLD)
+	{
+		Build(PrimitiveBounds, Quality);
+		return true;
+	}
+	return false;
+}
+
+float BVH::Cost() const
+{
+	if (Nodes.empty())
+		return 0.0f;
+	const float RootArea = RootBounds.SurfaceArea();
+	if (RootArea <= 0.0f)
+		return 0.0f;
+
+	// Each child costs the chance of a ray hitting its box, times one node visit or one test per primitive
+	float Total = 0.0f;
+	for (const WideBVHNode& Node : Nodes)
+	{
+		for (int i = 0; i < Node.ChildCount; i++)
+			Total += Node.ChildBounds(i).SurfaceArea() / RootArea * (Node.PrimitiveCount[i] > 0 ? Node.PrimitiveCount[i] : 1.0f);
+	}
+	return Total;
+}
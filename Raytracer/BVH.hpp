@@ -0,0 +1,288 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "VecUtils.hpp"
+
+// Axis-aligned bounding box; starts out empty
+struct AABB
+{
+	vec3 Min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	vec3 Max = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+
+	AABB() = default;
+	AABB(const vec3& Min, const vec3& Max) : Min(Min), Max(Max) {}
+
+	void Grow(const vec3& Point)
+	{
+		Min = VecUtils::min(Min, Point);
+		Max = VecUtils::max(Max, Point);
+	}
+
+	void Grow(const AABB& Other)
+	{
+		Min = VecUtils::min(Min, Other.Min);
+		Max = VecUtils::max(Max, Other.Max);
+	}
+
+	vec3 Centroid() const
+	{
+		return (Min + Max) * 0.5f;
+	}
+
+	float SurfaceArea() const
+	{
+		const vec3 Extent = Max - Min;
+		if (Extent.x < 0.0f)
+			return 0.0f;
+		return 2.0f * (Extent.x * Extent.y + Extent.y * Extent.z + Extent.z * Extent.x);
+	}
+
+	// Slab test; returns the distance at which the ray enters the box, or max float if it misses
+	// InvDirection is 1 / direction per component
+	float Intersect(const vec3& Origin, const vec3& InvDirection, float TMin, float TMax) const
+	{
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			float tNear = (Min[Axis] - Origin[Axis]) * InvDirection[Axis];
+			float tFar = (Max[Axis] - Origin[Axis]) * InvDirection[Axis];
+			if (tNear > tFar)
+				std::swap(tNear, tFar);
+			TMin = tNear > TMin ? tNear : TMin;
+			TMax = tFar < TMax ? tFar : TMax;
+			if (TMin > TMax)
+				return std::numeric_limits<float>::max();
+		}
+		return TMin;
+	}
+};
+
+// 32 byte node of the binary tree the builders produce; leaves have a non-zero Count
+struct BVHNode
+{
+	AABB Bounds;
+	// First primitive for leaves, left child for interior nodes (the right child follows it)
+	uint32_t LeftOrFirst = 0;
+	uint32_t Count = 0;
+
+	bool IsLeaf() const { return Count > 0; }
+};
+
+// Node of the 4-wide tree that is actually traversed, one cache line in size
+// Child boxes are quantized to 8 bits per plane on a power of two grid starting at the node's own minimum corner
+struct alignas(64) WideBVHNode
+{
+	static constexpr int WIDTH = 4;
+
+	vec3 Origin = vec3(0, 0, 0);
+	// Grid spacing along each axis is 2^Exponent
+	int8_t Exponent[3] = {};
+	uint8_t ChildCount = 0;
+	uint8_t QuantizedMin[3][WIDTH] = {};
+	uint8_t QuantizedMax[3][WIDTH] = {};
+	// First primitive for leaf children, node index otherwise
+	uint32_t Child[WIDTH] = {};
+	// Zero for interior children
+	uint8_t PrimitiveCount[WIDTH] = {};
+
+	float Scale(int Axis) const
+	{
+		return std::bit_cast<float>(static_cast<uint32_t>(Exponent[Axis] + 127) << 23);
+	}
+
+	AABB ChildBounds(int i) const
+	{
+		AABB Bounds;
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			Bounds.Min[Axis] = Origin[Axis] + QuantizedMin[Axis][i] * Scale(Axis);
+			Bounds.Max[Axis] = Origin[Axis] + QuantizedMax[Axis][i] * Scale(Axis);
+		}
+		return Bounds;
+	}
+
+	// Slab tests the ray against every child box at once
+	// Returns a bit per child that the ray enters between TMin and TMax, with the entry distances in tEnter
+	uint32_t IntersectChildren(const vec3& Origin, const vec3& InvDirection, float TMin, float TMax, float tEnter[WIDTH]) const
+	{
+#ifdef BVH_SSE2
+		__m128 Enter = _mm_set1_ps(TMin);
+		__m128 Exit = _mm_set1_ps(TMax);
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			// The near plane is the minimum for rays going in the positive direction, and the maximum otherwise
+			const bool Negative = InvDirection[Axis] < 0.0f;
+			const __m128 Near = Dequantize(Negative ? QuantizedMax[Axis] : QuantizedMin[Axis]);
+			const __m128 Far = Dequantize(Negative ? QuantizedMin[Axis] : QuantizedMax[Axis]);
+
+			// Origin + q * Scale - RayOrigin, times InvDirection, as one multiply-add per plane
+			const __m128 Step = _mm_set1_ps(Scale(Axis) * InvDirection[Axis]);
+			const __m128 Offset = _mm_set1_ps((this->Origin[Axis] - Origin[Axis]) * InvDirection[Axis]);
+			Enter = _mm_max_ps(_mm_add_ps(_mm_mul_ps(Near, Step), Offset), Enter);
+			Exit = _mm_min_ps(_mm_add_ps(_mm_mul_ps(Far, Step), Offset), Exit);
+		}
+		_mm_storeu_ps(tEnter, Enter);
+		return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(Enter, Exit))) & ((1u << ChildCount) - 1);
+#else
+		uint32_t Hits = 0;
+		for (int i = 0; i < ChildCount; i++)
+		{
+			float Enter = TMin;
+			float Exit = TMax;
+			for (int Axis = 0; Axis < 3; Axis++)
+			{
+				const bool Negative = InvDirection[Axis] < 0.0f;
+				const float Step = Scale(Axis) * InvDirection[Axis];
+				const float Offset = (this->Origin[Axis] - Origin[Axis]) * InvDirection[Axis];
+				const float Near = (Negative ? QuantizedMax : QuantizedMin)[Axis][i] * Step + Offset;
+				const float Far = (Negative ? QuantizedMin : QuantizedMax)[Axis][i] * Step + Offset;
+				Enter = Near > Enter ? Near : Enter;
+				Exit = Far < Exit ? Far : Exit;
+			}
+			tEnter[i] = Enter;
+			if (Enter <= Exit)
+				Hits |= 1u << i;
+		}
+		return Hits;
+#endif
+	}
+
+private:
+#ifdef BVH_SSE2
+	// Widens four 8 bit values to floats
+	static __m128 Dequantize(const uint8_t (&Values)[WIDTH])
+	{
+		uint32_t Packed;
+		std::memcpy(&Packed, Values, sizeof(Packed));
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i Bytes = _mm_cvtsi32_si128(static_cast<int>(Packed));
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(Bytes, Zero), Zero));
+	}
+#endif
+};
+
+static_assert(sizeof(WideBVHNode) == 64);
+
+// Trade-off between how quickly a BVH builds and how quickly it can be traversed
+enum class BVHBuildQuality
+{
+	// Linear BVH; Morton codes of the primitive centroids are radix sorted and split on their highest differing bit
+	Fast,
+	// Binned surface area heuristic
+	High
+};
+
+// Bounding volume hierarchy over anything that can be bounded
+// It is built as a binary tree, then collapsed into 4-wide nodes with quantized child boxes for traversal
+// It only stores primitive indices; the caller keeps the primitives and intersects them
+class BVH
+{
+public:
+	// Full rebuild over one box per primitive, spread over all threads
+	void Build(const std::vector<AABB>& PrimitiveBounds, BVHBuildQuality Quality = BVHBuildQuality::High);
+
+	// Recomputes every node's bounds for primitives that moved, keeping the tree's topology
+	// PrimitiveBounds must have the same size and order as when it was built
+	void Refit(const std::vector<AABB>& PrimitiveBounds);
+
+	// Refits if the primitive count is unchanged, but rebuilds when that would push the
+	// tree's SAH cost too far above what it was at the last build; returns true on a rebuild
+	bool Update(const std::vector<AABB>& PrimitiveBounds, BVHBuildQuality Quality = BVHBuildQuality::High);
+
+	// Surface area heuristic cost of the tree relative to its root; lower is better
+	float Cost() const;
+
+	bool Empty() const { return Nodes.empty(); }
+	size_t PrimitiveCount() const { return PrimitiveIndices.size(); }
+	size_t MemoryUsage() const { return Nodes.size() * sizeof(WideBVHNode) + PrimitiveIndices.size() * sizeof(uint32_t); }
+	const AABB& Bounds() const { return RootBounds; }
+
+	// Calls IntersectPrimitive(Index, TMax) for every primitive whose leaf the ray reaches before TMax
+	// IntersectPrimitive shrinks TMax on a hit and returns true to stop the traversal early
+	// Nearer children are visited first, so closest hit queries can cull most of the tree
+	template <typename Fn>
+	void Traverse(const vec3& Origin, const vec3& InvDirection, float TMin, float& TMax, Fn&& IntersectPrimitive) const
+	{
+		if (Nodes.empty() || RootBounds.Intersect(Origin, InvDirection, TMin, TMax) == std::numeric_limits<float>::max())
+			return;
+
+		// Small trees are a single leaf, which needs no box tests beyond the root's
+		if (Nodes[0].ChildCount == 1 && Nodes[0].PrimitiveCount[0] > 0)
+		{
+			for (uint32_t i = 0; i < Nodes[0].PrimitiveCount[0]; i++)
+			{
+				if (IntersectPrimitive(PrimitiveIndices[i], TMax))
+					return;
+			}
+			return;
+		}
+
+		// Children still to visit, with the distance at which the ray enters them
+		struct StackEntry { uint32_t Child; uint32_t PrimitiveCount; float t; };
+		StackEntry Stack[MAX_DEPTH * (WideBVHNode::WIDTH - 1) + 1];
+		int StackSize = 0;
+		uint32_t Current = 0;
+		while (true)
+		{
+			const WideBVHNode& Node = Nodes[Current];
+			float tEnter[WideBVHNode::WIDTH];
+			uint32_t Hits = Node.IntersectChildren(Origin, InvDirection, TMin, TMax, tEnter);
+
+			// Push the children that were hit farthest first, so the nearest is on top
+			const int First = StackSize;
+			for (; Hits != 0; Hits &= Hits - 1)
+			{
+				const int i = std::countr_zero(Hits);
+				int Slot = StackSize++;
+				for (; Slot > First && Stack[Slot - 1].t < tEnter[i]; Slot--)
+					Stack[Slot] = Stack[Slot - 1];
+				Stack[Slot] = { Node.Child[i], Node.PrimitiveCount[i], tEnter[i] };
+			}
+
+			// Pop until the next interior node, intersecting leaves on the way
+			// Anything that a hit found since it was pushed has already beaten is skipped
+			while (true)
+			{
+				if (StackSize == 0)
+					return;
+				const StackEntry Entry = Stack[--StackSize];
+				if (Entry.t > TMax)
+					continue;
+				if (Entry.PrimitiveCount == 0)
+				{
+					Current = Entry.Child;
+					break;
+				}
+				for (uint32_t i = Entry.Child; i < Entry.Child + Entry.PrimitiveCount; i++)
+				{
+					if (IntersectPrimitive(PrimitiveIndices[i], TMax))
+						return;
+				}
+			}
+		}
+	}
+
+	// Deeper trees are never built, which bounds the traversal stack
+	static constexpr int MAX_DEPTH = 64;
+	// Leaves hold at most this many primitives, which must fit WideBVHNode::PrimitiveCount
+	static constexpr uint32_t MAX_LEAF_SIZE = 4;
+	// Refitting that raises the SAH cost by more than this factor triggers a rebuild
+	static constexpr float REBUILD_THRESHOLD = 1.5f;
+
+private:
+	void Collapse(const std::vector<BVHNode>& BinaryNodes, uint32_t BinaryIndex, uint32_t WideIndex);
+	AABB RefitNode(uint32_t Index, const std::vector<AABB>& PrimitiveBounds);
+
+	std::vector<WideBVHNode> Nodes{};
+	AABB RootBounds{};
+	std::vector<uint32_t> PrimitiveIndices{};
+	float BuildCost = 0.0f;
+};
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "Batch.hpp"
+#include "Denoiser.hpp"
+#include "ImageOutput.hpp"
+#include "ImageWriter.hpp"
+#include "Parallel.hpp"
+#include "PathTracer.hpp"
+#include "Rendering.hpp"
+#include "SceneLoader.hpp"
+
+namespace {
+	template <typename Fn>
+	double TimeMs(Fn&& F)
+	{
+		auto StartTime = std::chrono::high_resolution_clock::now();
+		F();
+		auto StopTime = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(StopTime - StartTime).count();
+	}
+
+	// Runs one job at a time on a thread that lasts as long as the worker, so a batch doesn't start a thread per frame
+	class Worker
+	{
+	public:
+		Worker() : Thread([this] { Run(); }) {}
+
+		~Worker()
+		{
+			{
+				std::lock_guard<std::mutex> Guard(Lock);
+				Stopping = true;
+			}
+			Changed.notify_all();
+			Thread.join();
+		}
+
+		// Hands Job to the thread; the previous one must have been waited for
+		void Start(std::function<void()> Job)
+		{
+			{
+				std::lock_guard<std::mutex> Guard(Lock);
+				Pending = std::move(Job);
+			}
+			Changed.notify_all();
+		}
+
+		// Returns once the job handed over last has finished
+		void Wait()
+		{
+			std::unique_lock<std::mutex> Guard(Lock);
+			Changed.wait(Guard, [this] { return !Pending; });
+		}
+
+	private:
+		void Run()
+		{
+			std::unique_lock<std::mutex> Guard(Lock);
+			while (true)
+			{
+				Changed.wait(Guard, [this] { return Pending || Stopping; });
+				if (!Pending)
+					return;
+				Guard.unlock();
+				Pending();
+				Guard.lock();
+				Pending = nullptr;
+				Changed.notify_all();
+			}
+		}
+
+		std::mutex Lock;
+		// Signalled when a job is handed over or finishes, or the worker is told to stop
+		std::condition_variable Changed;
+		// Cleared once the job has run
+		std::function<void()> Pending{};
+		bool Stopping = false;
+		std::thread Thread;
+	};
+}
+
+namespace Batch
+{
+	bool RenderFrames(const Scene& Source, const BatchSettings& Settings, BatchStats& Stats)
+	{
+		Stats = BatchStats();
+		if (Settings.LastFrame < Settings.FirstFrame)
+			return true;
+		auto StartTime = std::chrono::high_resolution_clock::now();
+
+		const std::filesystem::path Directory = std::filesystem::path(Settings.OutputPrefix).parent_path();
+		std::error_code Error;
+		if (!Directory.empty())
+			std::filesystem::create_directories(Directory, Error);
+
+		// A prefix ending in an image extension picks the format, e.g. out/frame.png writes out/frame0000.png
+		std::filesystem::path Prefix = Settings.OutputPrefix;
+		ImageFormat Format = ImageFormat::PPM;
+		if (ImageOutput::FormatFromPath(Settings.OutputPrefix, Format))
+			Prefix.replace_extension();
+		const std::string Extension = Format == ImageFormat::PNG ? ".png" : Format == ImageFormat::EXR ? ".exr" : ".ppm";
+		auto FramePath = [&](int Number)
+		{
+			char Digits[16];
+			std::snprintf(Digits, sizeof(Digits), "%04d", Number);
+			return Prefix.string() + Digits + Extension;
+		};
+
+		// One scene for each of the two frames in flight; frame n is built into and traced from slot n % 2
+		// The next frame is built on the builder thread while this one is traced on all the others, and traced
+		// frames are copied into the writer's queue, to be encoded and written while the next ones are traced
+		Scene Slots[2] = { Source, Source };
+		for (Scene& Slot : Slots)
+			Slot.Region.Enabled = false;
+		Framebuffer Frame;
+		PathTracer Tracer;
+		Denoiser Filter;
+		ImageWriter Writer;
+		Worker Builder;
+
+		auto Build = [&](Scene& Slot, int Number)
+		{
+			Source.Animation.Apply(Source.Animation.FrameTime(Number), Slot);
+			Slot.UpdateAcceleration();
+		};
+		auto Trace = [&](Scene& Slot)
+		{
+			if (Slot.PathTracing.Enabled)
+			{
+				Tracer.Reset();
+				for (int Pass = 0; Pass < Settings.PathPasses; Pass++)
+					Tracer.RenderPass(Slot, Frame);
+			}
+			else
+			{
+				Rendering::Render(Slot, Frame);
+			}
+			if (Slot.Denoise.Enabled)
+				Filter.Apply(Slot.Denoise, Frame);
+		};
+		bool Written = true;
+
+		Stats.BuildMs += TimeMs([&] { Build(Slots[0], Settings.FirstFrame); });
+		for (int Number = Settings.FirstFrame; Number <= Settings.LastFrame && Written; Number++)
+		{
+			const int Slot = (Number - Settings.FirstFrame) & 1;
+			double BuildMs = 0.0;
+			double TraceMs = 0.0;
+			auto BuildNext = [&]
+			{
+				if (Number < Settings.LastFrame)
+					BuildMs = TimeMs([&] { Build(Slots[Slot ^ 1], Number + 1); });
+			};
+
+			if (Settings.Pipelined)
+			{
+				Builder.Start(BuildNext);
+				TraceMs = TimeMs([&] { Trace(Slots[Slot]); });
+				Builder.Wait();
+				Writer.Write(Frame.Pixels, Frame.Width, Frame.Height, FramePath(Number), Format);
+				// Frames are written a frame or two behind, so a failure stops the batch a little late, but
+				// doesn't let it trace the rest of the frames for nothing
+				Written = !Writer.Failed();
+			}
+			else
+			{
+				TraceMs = TimeMs([&] { Trace(Slots[Slot]); });
+				Stats.WriteMs += TimeMs([&] { Written = ImageOutput::WriteFile(FramePath(Number), ImageOutput::Encode(Format, Frame.Pixels, Frame.Width, Frame.Height)); });
+				BuildNext();
+			}
+			Stats.BuildMs += BuildMs;
+			Stats.TraceMs += TraceMs;
+			Stats.Frames++;
+
+			if (Settings.PrintProgress)
+			{
+				std::cout << "Frame " << Number << " traced in " << TraceMs << " ms";
+				if (Number < Settings.LastFrame)
+					std::cout << ", frame " << Number + 1 << " built in " << BuildMs << " ms";
+				std::cout << "." << std::endl;
+			}
+		}
+		if (Settings.Pipelined)
+		{
+			Written = Writer.Flush() && Written;
+			const ImageWriterStats Output = Writer.Stats();
+			Stats.WriteMs = Output.EncodeMs + Output.FileMs;
+		}
+
+		Stats.TotalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - StartTime).count();
+		return Written;
+	}
+
+	int Run(const std::string& ScenePath, const std::string& OutputPrefix, int FirstFrame, int LastFrame)
+	{
+		Scene Scene;
+		if (!SceneLoader::LoadScene(ScenePath, Scene))
+			return 1;
+		Raytracer::PrintSceneStats(Scene);
+
+		BatchSettings Settings;
+		Settings.FirstFrame = std::max(FirstFrame, 0);
+		Settings.LastFrame = LastFrame < 0 ? Scene.Animation.FrameCount - 1 : LastFrame;
+		Settings.OutputPrefix = OutputPrefix;
+		Settings.PrintProgress = true;
+		// Tracing already uses every core; a lone core would only be shared between building and tracing
+		Settings.Pipelined = Parallel::ThreadCount() > 1;
+
+		BatchStats Stats;
+		if (!RenderFrames(Scene, Settings, Stats))
+			return 1;
+		std::cout << "Rendered " << Stats.Frames << " frames in " << Stats.TotalMs << " ms ("
+			<< Stats.Frames / (Stats.TotalMs / 1000.0) << " frames per second); building took " << Stats.BuildMs
+			<< " ms, tracing " << Stats.TraceMs << " ms and writing " << Stats.WriteMs << " ms." << std::endl;
+		return 0;
+	}
+}
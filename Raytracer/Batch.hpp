@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+
+#include "Raytracer.hpp"
+
+// Which frames of an animation to render headlessly, and where to
+struct BatchSettings
+{
+	// Inclusive range
+	int FirstFrame = 0;
+	int LastFrame = 0;
+	// Each frame is written to this followed by its number; ending it in .png or .exr writes those instead of
+	// binary PPMs, e.g. out/frame.png writes out/frame0000.png onwards
+	std::string OutputPrefix{};
+	// Passes per frame when Scene.PathTracing is enabled
+	int PathPasses = 16;
+	// Builds the next frame's acceleration structures while tracing this one, and writes frames on an I/O thread
+	// while the ones after them are traced, instead of doing one thing after another; Run turns it off when there
+	// is only one core, which the stages would just take turns on
+	bool Pipelined = true;
+	bool PrintProgress = false;
+};
+
+// What rendering the frames took; stage times are summed over every frame, so with pipelining they add up to more
+// than the total
+struct BatchStats
+{
+	int Frames = 0;
+	double TotalMs = 0.0;
+	double BuildMs = 0.0;
+	double TraceMs = 0.0;
+	// Encoding the images and writing the files
+	double WriteMs = 0.0;
+};
+
+// Headless animation rendering, run with the --render <scene> <output prefix> [first frame] [last frame] command line flag
+namespace Batch
+{
+	// Renders Settings' frames of Source.Animation into numbered files; Source itself isn't changed
+	// Every frame is posed from a copy of Source, and two copies take turns so one can be built while the other
+	// is traced. The viewer's region doesn't apply, nor do temporal accumulation and checkerboard rendering
+	// Returns false, after reporting it, if a frame couldn't be written
+	bool RenderFrames(const Scene& Source, const BatchSettings& Settings, BatchStats& Stats);
+
+	// Loads the scene and renders frames FirstFrame to LastFrame, all of its animation by default, printing progress
+	// Returns the process exit code
+	int Run(const std::string& ScenePath, const std::string& OutputPrefix, int FirstFrame = 0, int LastFrame = -1);
+}
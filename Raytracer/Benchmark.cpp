@@ -0,0 +1,1146 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <numbers>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Batch.hpp"
+#include "Benchmark.hpp"
+#include "Checkerboard.hpp"
+#include "Denoiser.hpp"
+#include "Drawing.hpp"
+#include "ImageOutput.hpp"
+#include "ImageWriter.hpp"
+#include "Parallel.hpp"
+#include "PathTracer.hpp"
+#include "Raytracer.hpp"
+#include "Rendering.hpp"
+#include "Sampling.hpp"
+#include "SceneLoader.hpp"
+#include "ShadingMath.hpp"
+#include "Temporal.hpp"
+
+namespace {
+	// Runs Fn once and returns how long it took in milliseconds
+	template <typename Fn>
+	double TimeMs(Fn&& F)
+	{
+		auto StartTime = std::chrono::high_resolution_clock::now();
+		F();
+		auto StopTime = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(StopTime - StartTime).count();
+	}
+
+	// Named values reported alongside a timing, e.g. throughput
+	using Metrics = std::vector<std::pair<std::string, double>>;
+
+	struct Result
+	{
+		std::string Name;
+		double Ms = 0.0;
+		Metrics Extra{};
+	};
+
+	std::vector<Result> Results;
+
+	// Prints a result right away and keeps it for the JSON output
+	void Report(const std::string& Name, double Ms, const Metrics& Extra = {})
+	{
+		std::cout << Name << ": " << Ms << " ms";
+		for (size_t i = 0; i < Extra.size(); i++)
+			std::cout << (i == 0 ? " (" : ", ") << Extra[i].first << ": " << Extra[i].second;
+		std::cout << (Extra.empty() ? "" : ")") << std::endl;
+
+		Results.push_back({ Name, Ms, Extra });
+	}
+
+	// Correctness checks that failed, which make RunAll return nonzero
+	int Failures = 0;
+
+	// Reports whether a correctness check held, complaining when it didn't
+	void Check(const std::string& Name, bool Passed, const std::string& Failure)
+	{
+		Report(Name, 0.0, { { "passed", Passed ? 1.0 : 0.0 } });
+		if (!Passed)
+		{
+			std::cerr << Failure << "\n";
+			Failures++;
+		}
+	}
+
+	void WriteJson(const std::string& Path)
+	{
+		std::ofstream File(Path);
+		File << "[\n";
+		for (size_t i = 0; i < Results.size(); i++)
+		{
+			const Result& r = Results[i];
+			File << "  { \"name\": \"" << r.Name << "\", \"ms\": " << r.Ms;
+			for (const auto& [Key, Value] : r.Extra)
+				File << ", \"" << Key << "\": " << Value;
+			File << " }" << (i + 1 < Results.size() ? "," : "") << "\n";
+		}
+		File << "]\n";
+	}
+
+	// Traces one ray per pixel, the same way the viewer does
+	FrameStats RenderFrame(Scene& Scene)
+	{
+		Framebuffer Frame;
+		return Rendering::Render(Scene, Frame);
+	}
+
+	// Average time per frame over FrameCount frames
+	double RenderMs(Scene& Scene, int FrameCount)
+	{
+		Scene.UpdateAcceleration();
+		return TimeMs([&] {
+			for (int i = 0; i < FrameCount; i++)
+				RenderFrame(Scene);
+		}) / FrameCount;
+	}
+
+	// The demo scene, with either the old giant sphere or a plane as the floor
+	Scene DemoScene(bool PlaneFloor)
+	{
+		Scene Scene;
+		Scene.AddSphere(vec3(0, -1, 4), 1, Colors::Red, 100, 0.1f);
+		Scene.AddSphere(vec3(2, 0, 5), 1, Colors::Blue, 1000, 0.5f);
+		Scene.AddSphere(vec3(-2, 0, 5), 1, Colors::Green, 10, 0.2f);
+		if (PlaneFloor)
+			Scene.AddPlane(vec3(0, -1, 0), vec3(0, 1, 0), Colors::Yellow, 10, 0.1f);
+		else
+			Scene.AddSphere(vec3(0, -1001, 0), 1000, Colors::Yellow, 10, 0.1f);
+		Scene.AddAmbientLight(0.2f);
+		Scene.AddPointLight(2.5f, vec3(2, 1, 0));
+		return Scene;
+	}
+
+	double MBPerSecond(size_t Bytes, double Ms)
+	{
+		return Bytes / (1024.0 * 1024.0) / (Ms / 1000.0);
+	}
+
+	// Builds a large scene description in memory; the values are arbitrary but deterministic
+	std::string GenerateSceneText(int SphereCount)
+	{
+		std::string Text = "background 1 1 1\norigin 0 0 0\nambient 0.2\npoint 2.5 2 1 0\ndirectional 0.5 1 4 4\n";
+		Text.reserve(SphereCount * 64);
+
+		char Line[128];
+		for (int i = 0; i < SphereCount; i++)
+		{
+			int Length = std::snprintf(Line, sizeof(Line), "sphere %.3f %.3f %.3f %.3f %.3f %.3f %.3f %d %.2f\n",
+				(i % 97) * 0.25f, (i % 89) * -0.5f, 4.0f + (i % 83), 0.5f + (i % 7) * 0.1f,
+				(i % 3) / 2.0f, (i % 5) / 4.0f, (i % 7) / 6.0f, (i % 4) * 250, (i % 10) / 10.0f);
+			Text.append(Line, Length);
+		}
+		return Text;
+	}
+
+	void BenchmarkSceneParsing()
+	{
+		const std::string Text = GenerateSceneText(1'000'000);
+
+		Scene Parsed;
+		double ParseMs = TimeMs([&] { SceneLoader::ParseScene(Text, Parsed); });
+		Report("Scene parse (memory)", ParseMs, { { "MB/s", MBPerSecond(Text.size(), ParseMs) } });
+
+		// Same description, but streamed from disk
+		const std::filesystem::path Path = std::filesystem::temp_directory_path() / "raytracer_bench.scene";
+		std::ofstream(Path, std::ios::binary).write(Text.data(), Text.size());
+
+		Scene Loaded;
+		double LoadMs = TimeMs([&] { SceneLoader::LoadScene(Path.string(), Loaded); });
+		Report("Scene load (file)", LoadMs, { { "MB/s", MBPerSecond(Text.size(), LoadMs) } });
+
+		std::filesystem::remove(Path);
+	}
+
+	// Writes a flat Size x Size grid of quads as an OBJ file, giving 2 * Size^2 triangles
+	void WriteGridObj(const std::filesystem::path& Path, int Size)
+	{
+		std::ofstream File(Path, std::ios::binary);
+		char Line[128];
+		for (int z = 0; z <= Size; z++)
+		{
+			for (int x = 0; x <= Size; x++)
+			{
+				int Length = std::snprintf(Line, sizeof(Line), "v %.4f %.4f %.4f\n", x / static_cast<float>(Size), 0.0f, z / static_cast<float>(Size));
+				File.write(Line, Length);
+			}
+		}
+		for (int z = 0; z < Size; z++)
+		{
+			for (int x = 0; x < Size; x++)
+			{
+				int i = z * (Size + 1) + x + 1;
+				int Length = std::snprintf(Line, sizeof(Line), "f %d %d %d %d\n", i, i + 1, i + Size + 2, i + Size + 1);
+				File.write(Line, Length);
+			}
+		}
+	}
+
+	void BenchmarkFloor()
+	{
+		constexpr int FrameCount = 10;
+		Scene Floors[2] = { DemoScene(false), DemoScene(true) };
+		const char* Names[2] = { "sphere", "plane" };
+
+		// The floors take turns and each keeps its fastest frame, so neither pays for running first
+		double FrameMs[2] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+		for (Scene& Floor : Floors)
+			Floor.UpdateAcceleration();
+		for (int i = 0; i < FrameCount; i++)
+		{
+			for (int Floor = 0; Floor < 2; Floor++)
+				FrameMs[Floor] = std::min(FrameMs[Floor], TimeMs([&] { RenderFrame(Floors[Floor]); }));
+		}
+		for (int Floor = 0; Floor < 2; Floor++)
+			Report(std::string("Demo frame, ") + Names[Floor] + " floor", FrameMs[Floor]);
+
+		// Frames mostly time shading, which is the same for both; rays fanned out below the horizon at the floor
+		// alone show what the intersection itself costs
+		constexpr int RayCount = 1 << 20;
+		std::vector<Ray> Rays;
+		Rays.reserve(RayCount);
+		Sampling::Random Rng(1);
+		for (int i = 0; i < RayCount; i++)
+			Rays.push_back(Ray(vec3(0, 0, 0), vec3(Rng.Next() * 2.0f - 1.0f, -0.05f - Rng.Next(), 1.0f)));
+		for (int Floor = 0; Floor < 2; Floor++)
+		{
+			Scene FloorOnly;
+			if (Floor == 0)
+				FloorOnly.AddSphere(vec3(0, -1001, 0), 1000, Colors::Yellow);
+			else
+				FloorOnly.AddPlane(vec3(0, -1, 0), vec3(0, 1, 0), Colors::Yellow);
+			FloorOnly.UpdateAcceleration();
+
+			size_t Hits = 0;
+			const double Ms = TimeMs([&] {
+				std::visit([&](const auto& Objects)
+				{
+					for (const Ray& R : Rays)
+						Hits += Raytracer::ClosestHit(FloorOnly, Objects, R, 1e-6f, std::numeric_limits<float>::max()).has_value();
+				}, FloorOnly.Objects);
+			});
+			Report(std::string("Floor rays, ") + Names[Floor], Ms, {
+				{ "million rays per second", RayCount / (Ms * 1000.0) },
+				{ "hit %", 100.0 * Hits / RayCount } });
+		}
+	}
+
+	// The demo scene lit by a ring of dim point lights plus a directional light, so shading dominates the frame
+	Scene RingLitScene(int LightCount)
+	{
+		Scene Lit = DemoScene(true);
+		for (int i = 0; i < LightCount; i++)
+		{
+			const float Angle = i * 2.0f * std::numbers::pi_v<float> / LightCount;
+			Lit.AddPointLight(0.6f / LightCount, vec3(6.0f * std::cos(Angle), 3.0f, 5.0f + 6.0f * std::sin(Angle)));
+		}
+		Lit.AddDirectionalLight(0.1f, vec3(-1, 2, -1));
+		return Lit;
+	}
+
+	void BenchmarkLights()
+	{
+		constexpr int LightCount = 64;
+		Scene Lit = RingLitScene(LightCount);
+		double FrameMs = RenderMs(Lit, 1);
+		Report("Demo frame, 65 lights", FrameMs, { { "ms per light", FrameMs / (LightCount + 1) } });
+	}
+
+	// The ring lit scene seen from a slowly moving camera, with and without the shadow cache
+	// Accuracy is the share of cache hits that agree with the shadow ray they replaced
+	void BenchmarkShadowCache()
+	{
+		Scene Lit = RingLitScene(64);
+		Report("Demo frame, 65 lights, moving camera", RenderMs(Lit, 1));
+
+		Lit.CacheShadows = true;
+		Report("Demo frame, 65 lights, cold shadow cache", RenderMs(Lit, 1));
+
+		auto CacheMetrics = [&]() -> Metrics
+		{
+			const ShadowCacheStats Stats = Lit.Shadows.Stats();
+			return { { "hit rate %", 100.0 * Stats.Hits / std::max<uint64_t>(Stats.Lookups, 1) } };
+		};
+		Lit.Camera.Position.x += 0.05f;
+		double FrameMs = RenderMs(Lit, 1);
+		Report("Demo frame, 65 lights, warm shadow cache", FrameMs, CacheMetrics());
+
+		// Moving one sphere only invalidates the regions whose shadow rays could pass by it
+		Lit.Spheres[1].Origin.y += 0.5f;
+		Lit.Camera.Position.x += 0.05f;
+		FrameMs = RenderMs(Lit, 1);
+		Report("Demo frame, 65 lights, shadow cache after moving a sphere", FrameMs, CacheMetrics());
+
+		Lit.Shadows.Verify = true;
+		Lit.Camera.Position.x += 0.05f;
+		FrameMs = RenderMs(Lit, 1);
+		const ShadowCacheStats Stats = Lit.Shadows.Stats();
+		Report("Demo frame, 65 lights, verifying shadow cache", FrameMs, {
+			{ "accuracy %", 100.0 * (1.0 - static_cast<double>(Stats.Mismatches) / std::max<uint64_t>(Stats.Verified, 1)) },
+			{ "verified hits", static_cast<double>(Stats.Verified) },
+			{ "MB", Lit.Shadows.MemoryUsage() / (1024.0 * 1024.0) } });
+	}
+
+	// Thousands of dim point lights scattered over the demo scene, sampled through the light tree
+	// With a fixed number of samples the frame time should barely grow with the light count
+	void BenchmarkManyLights()
+	{
+		constexpr int Samples = 8;
+		for (int LightCount : { 100, 1000, 10000 })
+		{
+			Scene Lit = DemoScene(true);
+			Sampling::Random Rng(12345);
+			for (int i = 0; i < LightCount; i++)
+				Lit.AddPointLight(0.8f / LightCount, vec3(Rng.Next() * 12 - 6, Rng.Next() * 4, Rng.Next() * 10));
+
+			Lit.LightSamples = Samples;
+			double FrameMs = RenderMs(Lit, 1);
+			Report("Demo frame, " + std::to_string(LightCount) + " lights, " + std::to_string(Samples) + " samples", FrameMs,
+				{ { "light tree KB", Lit.LightsByType.PointTree.MemoryUsage() / 1024.0 } });
+		}
+	}
+
+	// Lights with falloff scattered over the demo scene and evaluated exactly; the higher the cutoff, the fewer
+	// lights each point finds in its cell of the light grid. The lowest cutoff reaches nearly everything, as without culling
+	void BenchmarkLightCulling()
+	{
+		constexpr int LightCount = 1000;
+		Scene Lit = DemoScene(true);
+		Sampling::Random Rng(12345);
+		for (int i = 0; i < LightCount; i++)
+			Lit.AddPointLight(0.1f, vec3(Rng.Next() * 12 - 6, Rng.Next() * 4 - 0.5f, Rng.Next() * 10), true);
+
+		const std::pair<float, std::string> Cutoffs[] = { { 1e-4f, "0.0001" }, { 0.01f, "0.01" }, { 0.05f, "0.05" } };
+		for (const auto& [Cutoff, Name] : Cutoffs)
+		{
+			Lit.LightCutoff = Cutoff;
+			Lit.UpdateAcceleration();
+			double LightsPerPixel = 0.0;
+			double FrameMs = TimeMs([&] { LightsPerPixel = RenderFrame(Lit).LightsPerPixel; });
+			Report("Demo frame, 1000 falloff lights, cutoff " + Name, FrameMs, {
+				{ "lights per pixel", LightsPerPixel },
+				{ "influence radius", Lit.LightsByType.PointRadius.back() },
+				{ "light grid KB", Lit.LightsByType.BoundedPointGrid.MemoryUsage() / 1024.0 } });
+		}
+	}
+
+	// RMS difference between two frames as displayed
+	double DisplayRmsError(const Framebuffer& a, const Framebuffer& b)
+	{
+		double SquaredError = 0.0;
+		for (size_t i = 0; i < a.Pixels.size(); i++)
+		{
+			for (int Channel = 0; Channel < 3; Channel++)
+			{
+				const double Difference = Drawing::DisplayValue(a.Pixels[i][Channel]) - Drawing::DisplayValue(b.Pixels[i][Channel]);
+				SquaredError += Difference * Difference / 3.0;
+			}
+		}
+		return std::sqrt(SquaredError / a.Pixels.size());
+	}
+
+	// The demo scene without anti-aliasing, with adaptive anti-aliasing, and with every pixel refined, which is what
+	// uniform supersampling at the same rate would cost; the error is the RMS difference in displayed luminance
+	// between the adaptive and the uniform image
+	void BenchmarkAntiAliasing()
+	{
+		Scene Demo = DemoScene(true);
+		Demo.UpdateAcceleration();
+		Framebuffer Adaptive;
+		Framebuffer Uniform;
+
+		double FrameMs = TimeMs([&] { Rendering::Render(Demo, Adaptive); });
+		Report("Demo frame, no anti-aliasing", FrameMs);
+
+		Demo.AntiAliasing.EdgeSamples = 16;
+		FrameStats Stats;
+		FrameMs = TimeMs([&] { Stats = Rendering::Render(Demo, Adaptive); });
+		const double AdaptiveMs = FrameMs;
+		Demo.AntiAliasing.RefineAll = true;
+		FrameMs = TimeMs([&] { Rendering::Render(Demo, Uniform); });
+
+		Report("Demo frame, adaptive anti-aliasing", AdaptiveMs, {
+			{ "samples per pixel", Stats.SamplesPerPixel },
+			{ "refined pixels %", 100.0 * Stats.RefinedPixels },
+			{ "RMS error against uniform", DisplayRmsError(Adaptive, Uniform) } });
+		Report("Demo frame, uniform 17x supersampling", FrameMs);
+	}
+
+	// The anti-aliased demo scene with a 128 pixel region moving across it every frame, at each stride, against the
+	// full frame; the error is over the whole frame, so it measures the interpolated part
+	void BenchmarkRegion()
+	{
+		constexpr int FRAMES = 8;
+		Scene Demo = DemoScene(true);
+		Demo.AntiAliasing.EdgeSamples = 16;
+		Demo.UpdateAcceleration();
+		Framebuffer Full;
+		const double FullMs = TimeMs([&] { Rendering::Render(Demo, Full); });
+		Report("Demo frame, anti-aliased everywhere", FullMs);
+
+		Demo.Region.Enabled = true;
+		for (int Stride : { 2, 4 })
+		{
+			Demo.Region.Stride = Stride;
+			Framebuffer Frame;
+			FrameStats Stats;
+			double Error = 0.0;
+			double Ms = 0.0;
+			for (int i = 0; i < FRAMES; i++)
+			{
+				Demo.Region.Left = 32 * i;
+				Ms += TimeMs([&] { Stats = Rendering::Render(Demo, Frame); });
+				Error += DisplayRmsError(Frame, Full);
+			}
+			Report("Demo frame, moving region, stride " + std::to_string(Stride), Ms / FRAMES, {
+				{ "samples per pixel", Stats.SamplesPerPixel },
+				{ "RMS error", Error / FRAMES } });
+		}
+	}
+
+	// Temporal accumulation on the demo scene without anti-aliasing, against a supersampled render from the same place
+	// Still: the error of one frame, then of 16 blended frames. Moving: 16 frames with the camera sliding sideways,
+	// where only reprojected history can help
+	void BenchmarkTemporal()
+	{
+		constexpr int FRAMES = 16;
+		Scene Demo = DemoScene(true);
+		Demo.UpdateAcceleration();
+
+		auto ReferenceAt = [&](vec3 Origin)
+		{
+			Scene Supersampled = Demo;
+			Supersampled.Camera.Position = Origin;
+			Supersampled.AntiAliasing.EdgeSamples = 16;
+			Supersampled.AntiAliasing.RefineAll = true;
+			Supersampled.UpdateAcceleration();
+			Framebuffer Reference;
+			Rendering::Render(Supersampled, Reference);
+			return Reference;
+		};
+
+		Framebuffer Frame;
+		const Framebuffer StillReference = ReferenceAt(Demo.Camera.Position);
+		Rendering::Render(Demo, Frame);
+		const double SingleError = DisplayRmsError(Frame, StillReference);
+
+		TemporalAccumulator Temporal;
+		TemporalStats Stats;
+		double AccumulateMs = 0.0;
+		for (int i = 0; i < FRAMES; i++)
+		{
+			const vec2 Jitter = Temporal.NextJitter();
+			Rendering::Render(Demo, Frame, Jitter);
+			AccumulateMs += TimeMs([&] { Stats = Temporal.Accumulate(Demo.Temporal, Demo.Camera, Jitter, Frame); });
+		}
+		Report("Temporal accumulation, still camera", AccumulateMs / FRAMES, {
+			{ "RMS error of one frame", SingleError },
+			{ "RMS error after 16 frames", DisplayRmsError(Frame, StillReference) } });
+
+		Temporal.Reset();
+		AccumulateMs = 0.0;
+		for (int i = 0; i < FRAMES; i++)
+		{
+			Demo.Camera.Position = vec3(0.02f * i, 0.0f, 0.0f);
+			const vec2 Jitter = Temporal.NextJitter();
+			Rendering::Render(Demo, Frame, Jitter);
+			AccumulateMs += TimeMs([&] { Stats = Temporal.Accumulate(Demo.Temporal, Demo.Camera, Jitter, Frame); });
+		}
+		const Framebuffer MovingReference = ReferenceAt(Demo.Camera.Position);
+		const double MovingError = DisplayRmsError(Frame, MovingReference);
+		Rendering::Render(Demo, Frame);
+		Report("Temporal accumulation, moving camera", AccumulateMs / FRAMES, {
+			{ "reused pixels %", 100.0 * Stats.ReusedPixels },
+			{ "frames of history", Stats.AverageHistory },
+			{ "RMS error of one frame", DisplayRmsError(Frame, MovingReference) },
+			{ "RMS error after 16 frames", MovingError } });
+	}
+
+	// Checkerboard frames of the demo scene against full ones, with the camera still and sliding sideways; the error is
+	// against a full render from the same place, and shows what reconstruction gets wrong
+	void BenchmarkCheckerboard()
+	{
+		constexpr int FRAMES = 16;
+		Scene Demo = DemoScene(true);
+		Demo.UpdateAcceleration();
+
+		Framebuffer Full;
+		const double FullMs = TimeMs([&] {
+			for (int i = 0; i < FRAMES; i++)
+				Rendering::Render(Demo, Full);
+		}) / FRAMES;
+		Report("Demo frame, every pixel", FullMs);
+
+		const std::pair<float, const char*> Motions[] = { { 0.0f, "still camera" }, { 0.02f, "moving camera" } };
+		for (const auto& [Speed, Name] : Motions)
+		{
+			Framebuffer Frame;
+			CheckerboardReconstructor Checkerboard;
+			CheckerboardStats Stats;
+			double RenderMs = 0.0;
+			double ReconstructMs = 0.0;
+			double Error = 0.0;
+			for (int i = 0; i < FRAMES; i++)
+			{
+				Demo.Camera.Position = vec3(Speed * i, 0.0f, 0.0f);
+				const PixelSet Pixels = Checkerboard.NextPixels();
+				RenderMs += TimeMs([&] { Rendering::Render(Demo, Frame, vec2(0, 0), Pixels); });
+				ReconstructMs += TimeMs([&] { Stats = Checkerboard.Reconstruct(Demo.Checkerboard, Demo.Camera, Pixels, Frame); });
+				Rendering::Render(Demo, Full);
+				Error += DisplayRmsError(Frame, Full);
+			}
+			Report(std::string("Demo checkerboard frame, ") + Name, (RenderMs + ReconstructMs) / FRAMES, {
+				{ "reconstruct ms", ReconstructMs / FRAMES },
+				{ "reused pixels %", 100.0 * Stats.ReusedPixels },
+				{ "interpolated pixels %", 100.0 * Stats.InterpolatedPixels },
+				{ "RMS error", Error / FRAMES } });
+		}
+	}
+
+	// The demo spheres in a closed room with a light in the ceiling, so no path escapes the scene
+	Scene RoomScene()
+	{
+		Scene Scene;
+		Scene.AddSphere(vec3(0, -1, 4), 1, Colors::Red, 100, 0.1f);
+		Scene.AddSphere(vec3(2, 0, 5), 1, Colors::Blue, 1000, 0.5f);
+		Scene.AddSphere(vec3(-2, 0, 5), 1, Colors::Green, 10, 0.2f);
+		const color4 Wall = Colors::White * 0.8f;
+		Scene.AddPlane(vec3(0, -2, 0), vec3(0, 1, 0), Wall);
+		Scene.AddPlane(vec3(0, 3, 0), vec3(0, -1, 0), Wall);
+		Scene.AddPlane(vec3(-4, 0, 0), vec3(1, 0, 0), Colors::Red * 0.8f);
+		Scene.AddPlane(vec3(4, 0, 0), vec3(-1, 0, 0), Colors::Green * 0.8f);
+		Scene.AddPlane(vec3(0, 0, 8), vec3(0, 0, -1), Wall);
+		Scene.AddPlane(vec3(0, 0, -2), vec3(0, 0, 1), Wall);
+		Scene.AddPointLight(2.5f, vec3(0, 2.5f, 3));
+		return Scene;
+	}
+
+	// One pass at a time, with and without Russian roulette; the error is against a 64 pass render of the same scene
+	// and shows what the shorter paths give up. Without Russian roulette every path runs to MaxBounces
+	void BenchmarkPathTracer()
+	{
+		constexpr int PASSES = 8;
+		constexpr int REFERENCE_PASSES = 64;
+		Scene Room = RoomScene();
+		Room.UpdateAcceleration();
+
+		Framebuffer Reference;
+		PathTracer ReferenceTracer;
+		Room.PathTracing.Seed = 1000;
+		for (int Pass = 0; Pass < REFERENCE_PASSES; Pass++)
+			ReferenceTracer.RenderPass(Room, Reference);
+
+		const std::pair<int, const char*> Modes[] = { { 3, "Russian roulette" }, { 64, "no Russian roulette" } };
+		for (const auto& [MinBounces, Name] : Modes)
+		{
+			Room.PathTracing.Seed = 1;
+			Room.PathTracing.MinBounces = MinBounces;
+			Framebuffer Frame;
+			PathTracer Tracer;
+			FrameStats Stats;
+			const double Ms = TimeMs([&] {
+				for (int Pass = 0; Pass < PASSES; Pass++)
+					Stats = Tracer.RenderPass(Room, Frame);
+			}) / PASSES;
+			Report(std::string("Room path tracing pass, ") + Name, Ms, {
+				{ "bounces per path", Stats.BouncesPerSample },
+				{ "RMS error after 8 passes", DisplayRmsError(Frame, Reference) } });
+		}
+
+		// The same seed has to give the same image, bit for bit
+		Room.PathTracing.MinBounces = 3;
+		Framebuffer First;
+		Framebuffer Second;
+		PathTracer FirstTracer;
+		PathTracer SecondTracer;
+		for (int Pass = 0; Pass < 2; Pass++)
+		{
+			FirstTracer.RenderPass(Room, First);
+			SecondTracer.RenderPass(Room, Second);
+		}
+		const bool Identical = std::memcmp(First.Pixels.data(), Second.Pixels.data(), First.Pixels.size() * sizeof(color4)) == 0;
+		Check("Room path tracing, repeated with the same seed", Identical, "Path tracing with the same seed gave different images");
+	}
+
+	// The path traced demo scene after a few passes and denoising, against 64 passes without, timed end to end;
+	// the error is against a 256 pass render
+	void BenchmarkDenoiser()
+	{
+		constexpr int REFERENCE_PASSES = 256;
+		Scene Demo = DemoScene(true);
+		Demo.PathTracing.Enabled = true;
+		Demo.UpdateAcceleration();
+
+		Framebuffer Reference;
+		PathTracer ReferenceTracer;
+		Demo.PathTracing.Seed = 1000;
+		for (int Pass = 0; Pass < REFERENCE_PASSES; Pass++)
+			ReferenceTracer.RenderPass(Demo, Reference);
+		Demo.PathTracing.Seed = 1;
+
+		Denoiser Filter;
+		for (int Passes : { 1, 2, 4, 64 })
+		{
+			Framebuffer Frame;
+			PathTracer Tracer;
+			double DenoiseMs = 0.0;
+			const double Ms = TimeMs([&] {
+				for (int Pass = 0; Pass < Passes; Pass++)
+					Tracer.RenderPass(Demo, Frame);
+			});
+			const double NoisyError = DisplayRmsError(Frame, Reference);
+			if (Passes < 64)
+			{
+				DenoiseMs = TimeMs([&] { Filter.Apply(Demo.Denoise, Frame); });
+				Report("Demo path tracing, " + std::to_string(Passes) + " passes and denoising", Ms + DenoiseMs, {
+					{ "denoise ms", DenoiseMs },
+					{ "RMS error before denoising", NoisyError },
+					{ "RMS error", DisplayRmsError(Frame, Reference) } });
+			}
+			else
+				Report("Demo path tracing, 64 passes", Ms, { { "RMS error", NoisyError } });
+		}
+	}
+
+	// Lots of small spheres scattered in front of the camera; positions come from a fixed seed
+	Scene SphereCloud(int SphereCount)
+	{
+		Scene Scene;
+		Sampling::Random Rng(12345);
+		for (int i = 0; i < SphereCount; i++)
+			Scene.AddSphere(vec3(Rng.Next() * 20 - 10, Rng.Next() * 20 - 10, Rng.Next() * 20 + 5), 0.05f, Colors::Gray, 10);
+		Scene.AddAmbientLight(0.2f);
+		Scene.AddPointLight(0.8f, vec3(0, 10, 0));
+		return Scene;
+	}
+
+	void BenchmarkAcceleration()
+	{
+		constexpr int SphereCount = 1'000'000;
+		Scene Cloud = SphereCloud(SphereCount);
+
+		std::vector<AABB> Bounds;
+		for (const Sphere& s : Cloud.Spheres)
+			Bounds.emplace_back(s.Origin - vec3(s.Radius, s.Radius, s.Radius), s.Origin + vec3(s.Radius, s.Radius, s.Radius));
+
+		for (BVHBuildQuality Quality : { BVHBuildQuality::Fast, BVHBuildQuality::High })
+		{
+			const std::string Name = Quality == BVHBuildQuality::Fast ? "fast (LBVH)" : "high (binned SAH)";
+			BVH Tree;
+			double BuildMs = TimeMs([&] { Tree.Build(Bounds, Quality); });
+			Report("BVH build " + Name + ", 1M spheres", BuildMs, {
+				{ "ms per million primitives", BuildMs / (SphereCount / 1e6) },
+				{ "SAH cost", Tree.Cost() },
+				{ "MB", Tree.MemoryUsage() / (1024.0 * 1024.0) } });
+
+			Cloud.BuildQuality = Quality;
+			Cloud.Objects = BVH();
+			Report("Frame " + Name + ", 1M spheres", RenderMs(Cloud, 1));
+		}
+
+		// Small moves keep the tree's quality, so this should refit rather than rebuild
+		for (Sphere& s : Cloud.Spheres)
+			s.Origin.y += 0.01f;
+		double RefitMs = TimeMs([&] { Cloud.UpdateAcceleration(); });
+		Report("BVH update after small moves, 1M spheres", RefitMs, {
+			{ "refits", static_cast<double>(Cloud.LastUpdate.Refits) },
+			{ "rebuilds", static_cast<double>(Cloud.LastUpdate.Rebuilds) } });
+
+		// Same spheres through the uniform grid
+		UniformGrid Grid;
+		double GridMs = TimeMs([&] { Grid.Build(Bounds); });
+		Report("Grid build, 1M spheres", GridMs, {
+			{ "ms per million primitives", GridMs / (SphereCount / 1e6) },
+			{ "MB", Grid.MemoryUsage() / (1024.0 * 1024.0) } });
+
+		Cloud.Accelerator = AcceleratorType::Grid;
+		Report("Frame grid, 1M spheres", RenderMs(Cloud, 1));
+	}
+
+	// Frames of an animated sphere cloud, with every sphere and the camera moving, rendered with the build, trace and
+	// write stages one after the other and then pipelined; both ways have to write the same images
+	void BenchmarkAnimation()
+	{
+		constexpr int FrameCount = 12;
+		Scene Cloud = SphereCloud(100'000);
+		Sampling::Random Rng(54321);
+		for (uint32_t i = 0; i < Cloud.Spheres.size(); i++)
+		{
+			SphereAnimation& Keys = Cloud.Animation.Spheres.emplace_back();
+			Keys.Index = i;
+			Keys.Origin.Add(0.0f, Cloud.Spheres[i].Origin);
+			Keys.Origin.Add(1.0f, Cloud.Spheres[i].Origin + vec3(Rng.Next() - 0.5f, Rng.Next() - 0.5f, Rng.Next() - 0.5f));
+			Keys.Radius.Add(0.0f, Cloud.Spheres[i].Radius);
+		}
+		CameraAnimation& View = Cloud.Animation.Camera;
+		View.Position.Add(0.0f, vec3(0, 0, 0));
+		View.Position.Add(1.0f, vec3(2, 1, -2));
+		View.Yaw.Add(0.0f, 0.0f);
+		View.Yaw.Add(1.0f, -10.0f);
+		View.Pitch.Add(0.0f, 0.0f);
+		View.FieldOfView.Add(0.0f, Cloud.Camera.FieldOfView);
+		Cloud.Animation.FrameCount = FrameCount;
+		Cloud.Animation.FramesPerSecond = static_cast<float>(FrameCount);
+
+		const std::filesystem::path Directory = std::filesystem::temp_directory_path() / "raytracer_bench_frames";
+		for (bool Pipelined : { false, true })
+		{
+			BatchSettings Settings;
+			Settings.LastFrame = FrameCount - 1;
+			Settings.OutputPrefix = (Directory / (Pipelined ? "pipelined" : "sequential")).string();
+			Settings.Pipelined = Pipelined;
+			BatchStats Stats;
+			Batch::RenderFrames(Cloud, Settings, Stats);
+			Report(std::string("Animation frame, 100k moving spheres, ") + (Pipelined ? "pipelined" : "sequential"), Stats.TotalMs / Stats.Frames, {
+				{ "frames per second", Stats.Frames / (Stats.TotalMs / 1000.0) },
+				{ "build ms", Stats.BuildMs / Stats.Frames },
+				{ "trace ms", Stats.TraceMs / Stats.Frames },
+				{ "write ms", Stats.WriteMs / Stats.Frames } });
+		}
+
+		auto ReadFile = [](const std::filesystem::path& Path)
+		{
+			std::ifstream File(Path, std::ios::binary);
+			return std::string(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+		};
+		bool Identical = true;
+		for (int Frame = 0; Frame < FrameCount; Frame++)
+		{
+			char Name[16];
+			std::snprintf(Name, sizeof(Name), "%04d.ppm", Frame);
+			const std::string Sequential = ReadFile(Directory / (std::string("sequential") + Name));
+			Identical = Identical && !Sequential.empty() && Sequential == ReadFile(Directory / (std::string("pipelined") + Name));
+		}
+		Check("Animation frames, pipelined same as sequential", Identical, "Pipelined animation frames differ from sequential ones");
+
+		std::filesystem::remove_all(Directory);
+	}
+
+	// Encoding the demo frame, as MB/s of the image going in: 8 bit RGB for PPM and PNG, half float RGB for EXR
+	// PNG runs as one block, then in blocks of rows spread over the threads. Last, frames rendered one after another
+	// and saved as PNGs, first on the render thread and then handed to the writer thread
+	void BenchmarkImageOutput()
+	{
+		constexpr int Repeats = 8;
+		Scene Demo = DemoScene(true);
+		Demo.UpdateAcceleration();
+		Framebuffer Frame;
+		Rendering::Render(Demo, Frame);
+		const size_t PixelCount = Frame.Pixels.size();
+
+		auto Run = [&](const std::string& Name, size_t InputBytes, auto&& Encode)
+		{
+			size_t Size = 0;
+			const double Ms = TimeMs([&] {
+				for (int i = 0; i < Repeats; i++)
+					Size = Encode().size();
+			}) / Repeats;
+			Report("Encode " + Name, Ms, {
+				{ "MB/s", MBPerSecond(InputBytes, Ms) },
+				{ "compression ratio", static_cast<double>(InputBytes) / Size } });
+		};
+		Run("PPM", PixelCount * 3, [&] { return ImageOutput::EncodePPM(Frame.Pixels, Frame.Width, Frame.Height); });
+		Run("PNG, one block", PixelCount * 3, [&] { return ImageOutput::EncodePNG(Frame.Pixels, Frame.Width, Frame.Height, Frame.Height); });
+		Run("PNG, blocks of 32 rows", PixelCount * 3, [&] { return ImageOutput::EncodePNG(Frame.Pixels, Frame.Width, Frame.Height, 32); });
+		Run("EXR", PixelCount * 6, [&] { return ImageOutput::EncodeEXR(Frame.Pixels, Frame.Width, Frame.Height); });
+
+		const std::filesystem::path Directory = std::filesystem::temp_directory_path() / "raytracer_bench_images";
+		std::filesystem::create_directories(Directory);
+		auto FramePath = [&](int i) { return (Directory / ("frame" + std::to_string(i) + ".png")).string(); };
+		const double InlineMs = TimeMs([&] {
+			for (int i = 0; i < Repeats; i++)
+			{
+				Rendering::Render(Demo, Frame);
+				ImageOutput::WriteFile(FramePath(i), ImageOutput::EncodePNG(Frame.Pixels, Frame.Width, Frame.Height));
+			}
+		}) / Repeats;
+		ImageWriterStats Output;
+		const double AsyncMs = TimeMs([&] {
+			ImageWriter Writer;
+			for (int i = 0; i < Repeats; i++)
+			{
+				Rendering::Render(Demo, Frame);
+				Writer.Write(Frame.Pixels, Frame.Width, Frame.Height, FramePath(i), ImageFormat::PNG);
+			}
+			Writer.Flush();
+			Output = Writer.Stats();
+		}) / Repeats;
+		Report("Demo frame saved as PNG, on the render thread", InlineMs);
+		Report("Demo frame saved as PNG, on the writer thread", AsyncMs, {
+			{ "encode ms", Output.EncodeMs / Repeats },
+			{ "blocked ms", Output.BlockedMs / Repeats } });
+
+		std::filesystem::remove_all(Directory);
+	}
+
+	// Every top level structure on a cloud small enough for the linear scan to finish
+	void BenchmarkAccelerators()
+	{
+		Scene Cloud = SphereCloud(1000);
+		const std::pair<AcceleratorType, std::string> Accelerators[] = {
+			{ AcceleratorType::Linear, "linear" },
+			{ AcceleratorType::BVH, "BVH" },
+			{ AcceleratorType::Grid, "grid" } };
+		for (const auto& [Type, Name] : Accelerators)
+		{
+			Cloud.Accelerator = Type;
+			double FrameMs = RenderMs(Cloud, 1);
+			Report("Frame " + Name + ", 1k spheres", FrameMs, { { "build ms", Cloud.LastUpdate.BuildMs } });
+		}
+	}
+
+	// The quadratic formula version Sphere::Intersect replaced, kept as a baseline
+	float QuadraticIntersectSphere(const Ray& Ray, const Sphere& s, float TMin)
+	{
+		vec3 OriginToSphere = Ray.Origin - s.Origin;
+		float a = VecUtils::length2(Ray.Direction);
+		float b = 2 * VecUtils::dot(OriginToSphere, Ray.Direction);
+		float c = VecUtils::length2(OriginToSphere) - (s.Radius * s.Radius);
+
+		float Discriminant = b * b - 4 * a * c;
+		if (Discriminant < 0)
+			return std::numeric_limits<float>::max();
+
+		float t1 = (-b - std::sqrt(Discriminant)) / (2 * a);
+		float t2 = (-b + std::sqrt(Discriminant)) / (2 * a);
+		float t = t1 > TMin ? t1 : t2;
+		return t > TMin ? t : std::numeric_limits<float>::max();
+	}
+
+	// Nearest intersection in double precision, to measure the float versions' error against; -1 on a miss
+	double ReferenceIntersectSphere(const Ray& Ray, const Sphere& s)
+	{
+		const double x = double(s.Origin.x) - Ray.Origin.x;
+		const double y = double(s.Origin.y) - Ray.Origin.y;
+		const double z = double(s.Origin.z) - Ray.Origin.z;
+		const double HalfB = x * Ray.Direction.x + y * Ray.Direction.y + z * Ray.Direction.z;
+		const double ClosestX = x - HalfB * Ray.Direction.x;
+		const double ClosestY = y - HalfB * Ray.Direction.y;
+		const double ClosestZ = z - HalfB * Ray.Direction.z;
+		const double Discriminant = double(s.Radius) * s.Radius - (ClosestX * ClosestX + ClosestY * ClosestY + ClosestZ * ClosestZ);
+		return Discriminant < 0.0 ? -1.0 : HalfB - std::sqrt(Discriminant);
+	}
+
+	// Ray-sphere tests alone, outside of any traversal, against the sphere cloud
+	void BenchmarkSphereIntersection()
+	{
+		constexpr int RayCount = 4096;
+		Scene Cloud = SphereCloud(4096);
+		Cloud.Camera.Update(Drawing::ResX, Drawing::ResY);
+		std::vector<Ray> Rays;
+		for (int i = 0; i < RayCount; i++)
+		{
+			const vec3 Direction = Cloud.Camera.PixelDirection(static_cast<float>(i % 64 - 32 + Drawing::ResX / 2), static_cast<float>(i / 64 - 32 + Drawing::ResY / 2));
+			Rays.emplace_back(Cloud.Camera.Position, Direction);
+		}
+
+		// Summing the hits keeps the loops from being optimized away
+		auto Run = [&](auto&& Intersect)
+		{
+			double Sum = 0.0;
+			double Ms = TimeMs([&] {
+				for (const Ray& R : Rays)
+				{
+					for (const Sphere& s : Cloud.Spheres)
+					{
+						float t = Intersect(R, s);
+						if (t != std::numeric_limits<float>::max())
+							Sum += t;
+					}
+				}
+			});
+
+			// Largest error on the hits both agree on, away from grazing angles where either may miss
+			double MaxError = 0.0;
+			for (const Ray& R : Rays)
+			{
+				for (const Sphere& s : Cloud.Spheres)
+				{
+					const float t = Intersect(R, s);
+					const double Reference = ReferenceIntersectSphere(R, s);
+					if (t != std::numeric_limits<float>::max() && Reference > 0.0)
+						MaxError = std::max(MaxError, std::abs(t - Reference));
+				}
+			}
+			return std::pair(Ms, Metrics{
+				{ "million tests/s", static_cast<double>(RayCount) * Cloud.Spheres.size() / Ms / 1000.0 },
+				{ "max error", MaxError },
+				{ "sum", Sum } });
+		};
+
+		auto [QuadraticMs, Quadratic] = Run([](const Ray& R, const Sphere& s) { return QuadraticIntersectSphere(R, s, 1e-6f); });
+		auto [ConstantsMs, Constants] = Run([](const Ray& R, const Sphere& s) { return s.Intersect(R, 1e-6f); });
+		Report("Sphere tests, quadratic formula", QuadraticMs, Quadratic);
+		Report("Sphere tests, precomputed constants", ConstantsMs, Constants);
+	}
+
+	// Primary ray directions for a whole frame from a turned camera, a row at a time with Camera::RowDirections
+	// against a normalized Camera::PixelDirection per pixel, and how far apart they end up
+	void BenchmarkCameraRays()
+	{
+		constexpr int Frames = 64;
+		const int Width = Drawing::ResX;
+		const int Height = Drawing::ResY;
+		Camera View;
+		View.Yaw = 30.0f;
+		View.Pitch = -15.0f;
+		View.Update(Width, Height);
+
+		std::vector<float> X(Width), Y(Width), Z(Width);
+		float Checksum = 0.0f;
+		const double RowMs = TimeMs([&] {
+			for (int Frame = 0; Frame < Frames; Frame++)
+			{
+				for (int y = 0; y < Height; y++)
+				{
+					View.RowDirections(y, 0, Width, 0.0f, 0.0f, X.data(), Y.data(), Z.data());
+					Checksum += X[y % Width] + Z[Width - 1];
+				}
+			}
+		});
+		const double PixelMs = TimeMs([&] {
+			for (int Frame = 0; Frame < Frames; Frame++)
+			{
+				for (int y = 0; y < Height; y++)
+				{
+					for (int x = 0; x < Width; x++)
+					{
+						const vec3 Direction = VecUtils::normalize(View.PixelDirection(static_cast<float>(x), static_cast<float>(y)));
+						X[x] = Direction.x;
+						Z[x] = Direction.z;
+					}
+					Checksum += X[y % Width] + Z[Width - 1];
+				}
+			}
+		});
+
+		float MaxError = 0.0f;
+		for (int y = 0; y < Height; y++)
+		{
+			View.RowDirections(y, 0, Width, 0.0f, 0.0f, X.data(), Y.data(), Z.data());
+			for (int x = 0; x < Width; x++)
+			{
+				const vec3 Direction = VecUtils::normalize(View.PixelDirection(static_cast<float>(x), static_cast<float>(y)));
+				MaxError = std::max({ MaxError, std::abs(X[x] - Direction.x), std::abs(Y[x] - Direction.y), std::abs(Z[x] - Direction.z) });
+			}
+		}
+
+		const double Rays = double(Width) * Height * Frames;
+		Report("Camera rays, per pixel", PixelMs, { { "million rays/s", Rays / PixelMs / 1000.0 } });
+		Report("Camera rays, per row", RowMs, {
+			{ "million rays/s", Rays / RowMs / 1000.0 },
+			{ "max error", MaxError },
+			{ "checksum", Checksum } });
+
+		Scene Demo = DemoScene(true);
+		Demo.Camera.Position = vec3(-3, 1, 0);
+		Demo.Camera.Yaw = 30.0f;
+		Demo.Camera.Pitch = -10.0f;
+		Report("Demo frame, turned camera", RenderMs(Demo, 4));
+	}
+
+	// ShadingMath::Pow against std::pow: its worst error over every float in (0, 1] at the demo's specular exponents
+	// checked against the documented bound, its throughput, and what it saves on a frame
+	void BenchmarkPow()
+	{
+		const float Exponents[] = { 10.0f, 100.0f, 1000.0f };
+		double MaxError = 0.0;
+		for (float Exponent : Exponents)
+		{
+			for (float x = 1.0f; x > 0.0f; x = std::nextafter(x, 0.0f))
+			{
+				const double Exact = std::pow(static_cast<double>(x), static_cast<double>(Exponent));
+				if (Exact < ShadingMath::POW_MIN_RESULT)
+					break;
+				MaxError = std::max(MaxError, std::abs(ShadingMath::Pow(x, Exponent) - Exact) / Exact);
+			}
+		}
+		Report("Fast pow error", 0.0, { { "max relative error", MaxError } });
+		Check("Fast pow error, within bound", MaxError <= ShadingMath::POW_MAX_RELATIVE_ERROR,
+			"ShadingMath::Pow exceeds its error bound: " + std::to_string(MaxError));
+
+		// Cosines spread over [0, 1), the range specular highlights see
+		constexpr int Count = 1 << 16;
+		constexpr int Passes = 256;
+		std::vector<float> Inputs(Count);
+		for (int i = 0; i < Count; i++)
+			Inputs[i] = (i + 0.5f) / Count;
+		std::vector<float> Outputs(Count);
+		auto Run = [&](auto&& Pow)
+		{
+			return TimeMs([&] {
+				for (int Pass = 0; Pass < Passes; Pass++)
+				{
+					const float Exponent = Exponents[Pass % 3];
+					for (int i = 0; i < Count; i++)
+						Outputs[i] += Pow(Inputs[i], Exponent);
+				}
+			});
+		};
+		const double ExactMs = Run([](float x, float y) { return std::pow(x, y); });
+		const double FastMs = Run([](float x, float y) { return ShadingMath::Pow(x, y); });
+		const double Calls = double(Count) * Passes;
+		Report("std::pow", ExactMs, { { "million calls per second", Calls / ExactMs / 1000.0 } });
+		Report("ShadingMath::Pow", FastMs, { { "million calls per second", Calls / FastMs / 1000.0 }, { "checksum", Outputs[Count - 1] } });
+
+		Scene Lit = RingLitScene(64);
+		Lit.FastSpecular = false;
+		Report("Demo frame, 65 lights, std::pow specular", RenderMs(Lit, 1));
+		Lit.FastSpecular = true;
+		Report("Demo frame, 65 lights, fast specular", RenderMs(Lit, 1));
+	}
+
+	// Cost per value of the samplers, next to std::mt19937 which keeps state and can't be shared between threads,
+	// and how well each integrates a soft disk over the unit square with 16 and 256 points, as the RMS error over
+	// many seeds. Last, the same values filled in by one and by many ranges of threads have to match
+	void BenchmarkSampling()
+	{
+		constexpr uint32_t Count = 1 << 24;
+		float Checksum = 0.0f;
+		std::mt19937 Engine(12345);
+		std::uniform_real_distribution<float> Uniform(0.0f, 1.0f);
+		const double EngineMs = TimeMs([&] {
+			for (uint32_t i = 0; i < Count; i++)
+				Checksum += Uniform(Engine);
+		});
+		const double RandomMs = TimeMs([&] {
+			for (uint32_t i = 0; i < Count; i += 4)
+			{
+				Sampling::Random Rng(1, i);
+				Checksum += Rng.Next() + Rng.Next() + Rng.Next() + Rng.Next();
+			}
+		});
+		const double SobolMs = TimeMs([&] {
+			for (uint32_t i = 0; i < Count; i += 4)
+			{
+				Sampling::SobolSampler Sampler(1, i);
+				Checksum += Sampler.Next() + Sampler.Next() + Sampler.Next() + Sampler.Next();
+			}
+		});
+		Report("std::mt19937 floats", EngineMs, { { "million per second", Count / EngineMs / 1000.0 } });
+		Report("Sampling::Random floats", RandomMs, { { "million per second", Count / RandomMs / 1000.0 } });
+		Report("Sampling::SobolSampler floats", SobolMs, { { "million per second", Count / SobolMs / 1000.0 }, { "checksum", Checksum } });
+
+		// Smooth edged disk, so the error shows the points' distribution rather than the edge
+		auto Disk = [](float u, float v)
+		{
+			const float Distance = std::sqrt((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f));
+			return std::clamp((0.4f - Distance) / 0.05f + 0.5f, 0.0f, 1.0f);
+		};
+		constexpr uint32_t Seeds = 1024;
+		for (uint32_t Points : { 16u, 256u })
+		{
+			double Exact = 0.0;
+			Sampling::Random ReferencePoints(7);
+			for (int i = 0; i < 1 << 20; i++)
+				Exact += Disk(ReferencePoints.Next(), ReferencePoints.Next());
+			Exact /= 1 << 20;
+
+			double RandomError = 0.0;
+			double SobolError = 0.0;
+			for (uint32_t Seed = 0; Seed < Seeds; Seed++)
+			{
+				double RandomSum = 0.0;
+				double SobolSum = 0.0;
+				for (uint32_t i = 0; i < Points; i++)
+				{
+					Sampling::Random Rng(Seed, 0, i);
+					RandomSum += Disk(Rng.Next(), Rng.Next());
+					Sampling::SobolSampler Sampler(Seed, i);
+					SobolSum += Disk(Sampler.Next(), Sampler.Next());
+				}
+				RandomError += (RandomSum / Points - Exact) * (RandomSum / Points - Exact);
+				SobolError += (SobolSum / Points - Exact) * (SobolSum / Points - Exact);
+			}
+			Report("Soft disk integral, " + std::to_string(Points) + " points", 0.0, {
+				{ "random RMS error", std::sqrt(RandomError / Seeds) },
+				{ "scrambled Sobol RMS error", std::sqrt(SobolError / Seeds) } });
+		}
+
+		std::vector<float> Serial(Count / 16);
+		std::vector<float> Threaded(Count / 16);
+		auto Fill = [](std::vector<float>& Values, size_t Ranges)
+		{
+			Parallel::ForRanges(Values.size(), Ranges, [&](size_t Begin, size_t End, size_t)
+			{
+				for (size_t i = Begin; i < End; i++)
+				{
+					Sampling::SobolSampler Sampler(Sampling::Hash(static_cast<uint32_t>(i)), 3);
+					Sampler.Dimension = 9;
+					Values[i] = Sampler.Next() + Sampling::Random(5, static_cast<uint32_t>(i), 3).Next();
+				}
+			});
+		};
+		Fill(Serial, 1);
+		Fill(Threaded, 61);
+		Check("Sampling, filled by 1 and by 61 ranges", Serial == Threaded, "Sampling depends on how the work is split into ranges");
+	}
+
+	void BenchmarkObjLoading()
+	{
+		const std::filesystem::path Path = std::filesystem::temp_directory_path() / "raytracer_bench.obj";
+		WriteGridObj(Path, 1000);
+
+		TriangleMesh Mesh;
+		double LoadMs = TimeMs([&] { SceneLoader::LoadObj(Path.string(), Mesh); });
+		Report("OBJ load", LoadMs, {
+			{ "triangles", static_cast<double>(Mesh.TriangleCount()) },
+			{ "MB/s", MBPerSecond(std::filesystem::file_size(Path), LoadMs) } });
+
+		std::filesystem::remove(Path);
+	}
+}
+
+namespace Benchmark
+{
+	int RunAll(const std::string& JsonPath)
+	{
+		Results.clear();
+		Failures = 0;
+		BenchmarkSceneParsing();
+		BenchmarkObjLoading();
+		BenchmarkFloor();
+		BenchmarkLights();
+		BenchmarkShadowCache();
+		BenchmarkAntiAliasing();
+		BenchmarkRegion();
+		BenchmarkTemporal();
+		BenchmarkCheckerboard();
+		BenchmarkPathTracer();
+		BenchmarkDenoiser();
+		BenchmarkManyLights();
+		BenchmarkLightCulling();
+		BenchmarkAcceleration();
+		BenchmarkAccelerators();
+		BenchmarkAnimation();
+		BenchmarkImageOutput();
+		BenchmarkSphereIntersection();
+		BenchmarkCameraRays();
+		BenchmarkPow();
+		BenchmarkSampling();
+
+		if (!JsonPath.empty())
+			WriteJson(JsonPath);
+		if (Failures > 0)
+		{
+			std::cerr << Failures << " benchmark check(s) failed\n";
+			return 1;
+		}
+		return 0;
+	}
+}
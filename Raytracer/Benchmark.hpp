@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+
+// Headless benchmarks, run with the --bench [output.json] command line flag
+namespace Benchmark
+{
+	// Runs every benchmark and prints the timings, also writing them to JsonPath if one is given
+	// Returns the process exit code, nonzero if any correctness check failed
+	int RunAll(const std::string& JsonPath = "");
+}
@@ -0,0 +1,76 @@
+#include <cmath>
+#include <numbers>
+
+#include "Camera.hpp"
+
+namespace {
+	float Radians(float Degrees)
+	{
+		return Degrees * std::numbers::pi_v<float> / 180.0f;
+	}
+}
+
+void Camera::Update(int Width, int Height)
+{
+	const float ViewportHeight = 2.0f * std::tan(Radians(FieldOfView) * 0.5f);
+	const float ViewportWidth = ViewportHeight * Aspect;
+	PixelsPerUnit = vec2(Width / ViewportWidth, Height / ViewportHeight);
+	Center = vec2(static_cast<float>(Width / 2), static_cast<float>(Height / 2));
+
+	Axes[0] = Right();
+	Axes[1] = Up();
+	Axes[2] = Forward();
+	StepX = Axes[0] * (1.0f / PixelsPerUnit.x);
+	StepY = Axes[1] * (-1.0f / PixelsPerUnit.y);
+	TopLeft = Axes[2] - StepX * Center.x - StepY * Center.y;
+}
+
+vec3 Camera::Forward() const
+{
+	const float y = Radians(Yaw);
+	const float p = Radians(Pitch);
+	return vec3(std::sin(y) * std::cos(p), std::sin(p), std::cos(y) * std::cos(p));
+}
+
+vec3 Camera::Right() const
+{
+	const float y = Radians(Yaw);
+	return vec3(std::cos(y), 0.0f, -std::sin(y));
+}
+
+vec3 Camera::Up() const
+{
+	return VecUtils::cross(Forward(), Right());
+}
+
+void Camera::RowDirections(int y, int Begin, int Count, float OffsetX, float OffsetY, float* X, float* Y, float* Z) const
+{
+	// Locals, since the outputs could otherwise alias the camera's own members
+	const vec3 Start = PixelDirection(Begin + OffsetX, y + OffsetY);
+	const vec3 Step = StepX;
+	for (int i = 0; i < Count; i++)
+	{
+		const float dx = Start.x + Step.x * i;
+		const float dy = Start.y + Step.y * i;
+		const float dz = Start.z + Step.z * i;
+		const float InvLength = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz);
+		X[i] = dx * InvLength;
+		Y[i] = dy * InvLength;
+		Z[i] = dz * InvLength;
+	}
+}
+
+bool Camera::Project(const vec3& Point, vec2& Pixel) const
+{
+	return ProjectDirection(Point - Position, Pixel);
+}
+
+bool Camera::ProjectDirection(const vec3& Direction, vec2& Pixel) const
+{
+	const float Depth = VecUtils::dot(Direction, Axes[2]);
+	if (Depth <= 0.0f)
+		return false;
+	Pixel = vec2(Center.x + VecUtils::dot(Direction, Axes[0]) / Depth * PixelsPerUnit.x,
+		Center.y - VecUtils::dot(Direction, Axes[1]) / Depth * PixelsPerUnit.y);
+	return true;
+}
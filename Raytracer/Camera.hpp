@@ -0,0 +1,53 @@
+#pragma once
+#include "VecUtils.hpp"
+
+// Where the image is seen from; at zero yaw and pitch the camera looks down +z with +y up
+// Pixel positions are in pixels from the top left of the image, with pixel (x, y) sampled at (x, y); a pixel's
+// ray is a fixed direction plus x column steps and y row steps, all worked out once per frame by Update
+class Camera
+{
+public:
+	vec3 Position = vec3(0, 0, 0);
+	// Degrees; yaw turns to the right around +y, pitch tilts up
+	float Yaw = 0.0f;
+	float Pitch = 0.0f;
+	// Vertical field of view in degrees, and the width of the image over its height; the defaults frame the
+	// 1 x 1 viewport one unit in front of the camera that the renderer always used
+	float FieldOfView = 53.1301f;
+	float Aspect = 1.0f;
+
+	// Works out the per pixel steps for a Width x Height image; needed after changing any of the above, and done
+	// by the renderers at the start of every frame
+	void Update(int Width, int Height);
+
+	// Unit vectors of the camera, from Yaw and Pitch
+	vec3 Forward() const;
+	vec3 Right() const;
+	vec3 Up() const;
+
+	// Direction through a position on the image, not normalized
+	vec3 PixelDirection(float x, float y) const { return TopLeft + StepX * x + StepY * y; }
+
+	// Unit directions through Count pixels of row y, starting at column Begin, each moved by the offsets; a step
+	// per pixel and axis, then a normalization, over separate x, y and z arrays so compilers vectorize the row
+	void RowDirections(int y, int Begin, int Count, float OffsetX, float OffsetY, float* X, float* Y, float* Z) const;
+
+	// Position on the image a point is seen at; false if it is behind the camera
+	bool Project(const vec3& Point, vec2& Pixel) const;
+	// Same for a point infinitely far away in Direction, e.g. the background
+	bool ProjectDirection(const vec3& Direction, vec2& Pixel) const;
+
+	bool operator==(const Camera& Other) const = default;
+
+private:
+	// Right, Up and Forward as of the last Update
+	vec3 Axes[3] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) };
+	// Direction through pixel (0, 0), and the steps to the next column and row
+	vec3 TopLeft = vec3(0, 0, 1);
+	vec3 StepX = vec3(0, 0, 0);
+	vec3 StepY = vec3(0, 0, 0);
+	// The image's center, which the old canvas put at (Width / 2, Height / 2) rounded down, and pixels per unit
+	// on the plane one unit in front of the camera
+	vec2 Center = vec2(0, 0);
+	vec2 PixelsPerUnit = vec2(0, 0);
+};
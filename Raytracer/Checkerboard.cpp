@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Checkerboard.hpp"
+#include "Drawing.hpp"
+#include "Parallel.hpp"
+
+namespace {
+	constexpr float BACKGROUND = std::numeric_limits<float>::max();
+
+	// How far, in pixels, a pixel of last frame may be from where the point it stands in for was; further off, edges
+	// and highlights land in the wrong place, and interpolating does better
+	constexpr float REUSE_RADIUS = 0.3f;
+
+	bool Contains(PixelSet Pixels, int x, int y)
+	{
+		return Pixels == PixelSet::All || ((x + y) & 1) == (Pixels == PixelSet::Odd);
+	}
+
+	void CopyPixel(const Framebuffer& From, size_t FromIndex, Framebuffer& To, size_t ToIndex)
+	{
+		To.Pixels[ToIndex] = From.Pixels[FromIndex];
+		To.Surfaces[ToIndex] = From.Surfaces[FromIndex];
+		To.Depth[ToIndex] = From.Depth[FromIndex];
+		To.Normals[ToIndex] = From.Normals[FromIndex];
+		To.Albedo[ToIndex] = From.Albedo[FromIndex];
+	}
+
+	// Counts for one range of rows
+	struct FillCounts
+	{
+		uint64_t Traced = 0;
+		uint64_t Reused = 0;
+		uint64_t Interpolated = 0;
+	};
+}
+
+CheckerboardStats CheckerboardReconstructor::Reconstruct(const CheckerboardSettings& Settings, const Camera& View, PixelSet Traced, Framebuffer& Frame)
+{
+	const int Width = Frame.Width;
+	const int Height = Frame.Height;
+	const size_t PixelCount = Frame.Pixels.size();
+	const bool HasHistory = Last.Pixels.size() == PixelCount && Last.Width == Width;
+	const bool Moved = View != PreviousView;
+
+	// Last frame's traced pixel that saw the point on Surface, Depth along the ray through pixel (x, y);
+	// the closest one to where that point was that agrees, within REUSE_RADIUS. Returns false if none do
+	auto FindPrevious = [&](int x, int y, float Depth, const void* Surface, size_t& Found)
+	{
+		// Agreeing means hitting the same surface at the expected depth; the background only has to be the background
+		auto Agrees = [&](size_t Candidate, float Expected)
+		{
+			if (Depth == BACKGROUND)
+				return Last.Depth[Candidate] == BACKGROUND;
+			return Last.Surfaces[Candidate] == Surface && std::abs(Last.Depth[Candidate] - Expected) <= Settings.DepthTolerance * Expected;
+		};
+
+		// Without moving, nothing does
+		if (!Moved)
+		{
+			Found = size_t(y) * Width + x;
+			return Contains(Previous, x, y) && Agrees(Found, Depth);
+		}
+
+		// The background is infinitely far away, so only turning the camera moves it
+		const vec3 Direction = View.PixelDirection(static_cast<float>(x), static_cast<float>(y));
+		vec2 PreviousPos;
+		float Expected = BACKGROUND;
+		if (Depth == BACKGROUND)
+		{
+			if (!PreviousView.ProjectDirection(Direction, PreviousPos))
+				return false;
+		}
+		else
+		{
+			const vec3 Point = View.Position + VecUtils::normalize(Direction) * Depth;
+			if (!PreviousView.Project(Point, PreviousPos))
+				return false;
+			Expected = VecUtils::distance(Point, PreviousView.Position);
+		}
+		const float px = PreviousPos.x;
+		const float py = PreviousPos.y;
+		const int x0 = static_cast<int>(std::floor(px));
+		const int y0 = static_cast<int>(std::floor(py));
+
+		float Closest = REUSE_RADIUS * REUSE_RADIUS;
+		bool Matched = false;
+		for (int hy = y0; hy <= y0 + 1; hy++)
+		{
+			for (int hx = x0; hx <= x0 + 1; hx++)
+			{
+				if (hx < 0 || hy < 0 || hx >= Width || hy >= Height || !Contains(Previous, hx, hy))
+					continue;
+				const size_t Candidate = size_t(hy) * Width + hx;
+				if (!Agrees(Candidate, Expected))
+					continue;
+				const float Distance = (hx - px) * (hx - px) + (hy - py) * (hy - py);
+				if (Distance < Closest)
+				{
+					Closest = Distance;
+					Found = Candidate;
+					Matched = true;
+				}
+			}
+		}
+		return Matched;
+	};
+
+	const size_t Ranges = Parallel::RangeCount(Height, 16);
+	std::vector<FillCounts> RangeCounts(Ranges);
+	Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t Range)
+	{
+		FillCounts& Counts = RangeCounts[Range];
+		for (int y = static_cast<int>(Begin); y < static_cast<int>(End); y++)
+		{
+			for (int x = 0; x < Width; x++)
+			{
+				if (Contains(Traced, x, y))
+				{
+					Counts.Traced++;
+					continue;
+				}
+
+				// The four traced neighbours; past the edges of the frame, the one on the other side stands in
+				const size_t i = size_t(y) * Width + x;
+				const size_t Left = x > 0 ? i - 1 : i + 1;
+				const size_t Right = x + 1 < Width ? i + 1 : i - 1;
+				const size_t Up = y > 0 ? i - Width : i + Width;
+				const size_t Down = y + 1 < Height ? i + Width : i - Width;
+
+				if (HasHistory)
+				{
+					// Neighbours on a surface already tried would mostly find the same pixels again
+					bool Reused = false;
+					const void* Tried[4];
+					int TriedCount = 0;
+					for (size_t Neighbour : { Left, Right, Up, Down })
+					{
+						if (std::find(Tried, Tried + TriedCount, Frame.Surfaces[Neighbour]) != Tried + TriedCount)
+							continue;
+						Tried[TriedCount++] = Frame.Surfaces[Neighbour];
+						size_t Found;
+						if (FindPrevious(x, y, Frame.Depth[Neighbour], Frame.Surfaces[Neighbour], Found))
+						{
+							CopyPixel(Last, Found, Frame, i);
+							Frame.Depth[i] = Frame.Depth[Neighbour];
+							Reused = true;
+							break;
+						}
+					}
+					if (Reused)
+					{
+						Counts.Reused++;
+						continue;
+					}
+				}
+
+				// The pair of neighbours that differ least, with pairs on two different surfaces only as a last resort;
+				// the nearer of the two gives the guides
+				auto Difference = [&](size_t a, size_t b)
+				{
+					return std::abs(Drawing::DisplayLuminance(Frame.Pixels[a]) - Drawing::DisplayLuminance(Frame.Pixels[b]))
+						+ (Frame.Surfaces[a] != Frame.Surfaces[b] ? 1.0f : 0.0f);
+				};
+				const bool Horizontal = Difference(Left, Right) <= Difference(Up, Down);
+				const size_t a = Horizontal ? Left : Up;
+				const size_t b = Horizontal ? Right : Down;
+				const color4 Average = (Frame.Pixels[a] + Frame.Pixels[b]) * 0.5f;
+				CopyPixel(Frame, Frame.Depth[a] <= Frame.Depth[b] ? a : b, Frame, i);
+				Frame.Pixels[i] = Average;
+				Counts.Interpolated++;
+			}
+		}
+	});
+
+	Last = Frame;
+	Previous = Traced;
+	PreviousView = View;
+
+	FillCounts Total;
+	for (const FillCounts& Counts : RangeCounts)
+	{
+		Total.Traced += Counts.Traced;
+		Total.Reused += Counts.Reused;
+		Total.Interpolated += Counts.Interpolated;
+	}
+	CheckerboardStats Stats;
+	Stats.TracedPixels = static_cast<double>(Total.Traced) / PixelCount;
+	Stats.ReusedPixels = static_cast<double>(Total.Reused) / PixelCount;
+	Stats.InterpolatedPixels = static_cast<double>(Total.Interpolated) / PixelCount;
+	return Stats;
+}
+
+void CheckerboardReconstructor::Reset()
+{
+	Last = Framebuffer();
+	Previous = PixelSet::All;
+	PreviousView = Camera();
+}
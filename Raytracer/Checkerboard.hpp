@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+#include "Raytracer.hpp"
+#include "Rendering.hpp"
+
+// How the pixels a checkerboard frame didn't trace were filled in
+struct CheckerboardStats
+{
+	// Shares of all pixels; what isn't traced is either reused or interpolated
+	double TracedPixels = 0.0;
+	// Taken from last frame, where it traced the same point on the same surface
+	double ReusedPixels = 0.0;
+	// Interpolated from the pixels around them this frame
+	double InterpolatedPixels = 0.0;
+};
+
+// Fills in the half of a checkerboard frame that wasn't traced, so the viewer only traces half the pixels per frame
+// Each missing pixel is surrounded by four traced ones. Its point is taken to be at the depth of one of them, and a
+// pixel last frame traced right where that point was is reused if it hit the same surface at the same depth; the halves
+// alternate, so with a still camera last frame traced exactly the missing pixels. Anything else is interpolated along
+// whichever axis the image changes least across, which keeps edges sharp
+class CheckerboardReconstructor
+{
+public:
+	// The half to trace next; alternates every frame
+	PixelSet NextPixels() const { return Previous == PixelSet::Even ? PixelSet::Odd : PixelSet::Even; }
+
+	// Fills in the pixels of Frame outside Traced, which was rendered by View, along with their surfaces,
+	// depth, normals and albedo; starts over on its own when the frame size changes
+	CheckerboardStats Reconstruct(const CheckerboardSettings& Settings, const Camera& View, PixelSet Traced, Framebuffer& Frame);
+
+	void Reset();
+
+private:
+	// Last frame after reconstruction; only its traced pixels are ever reused
+	Framebuffer Last{};
+	PixelSet Previous = PixelSet::All;
+	Camera PreviousView{};
+};
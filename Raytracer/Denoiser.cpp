@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Denoiser.hpp"
+#include "Drawing.hpp"
+#include "Parallel.hpp"
+#include "ShadingMath.hpp"
+
+namespace {
+	// B3 spline, the kernel of the à-trous transform
+	constexpr float KERNEL[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+	// Depth given to the background, and to the padding, whose depth tells it apart from every pixel
+	constexpr float BACKGROUND_DEPTH = 1e10f;
+	constexpr float PADDING_DEPTH = 1e20f;
+
+	// The planes a pass reads
+	struct Planes
+	{
+		const float* Color[3];
+		const float* Luminance;
+		const float* Depth;
+		const float* InverseDepth;
+		const float* Normal[3];
+		const float* Albedo[3];
+	};
+
+	// Per pass constants of the weights
+	struct Falloff
+	{
+		float InverseColor;
+		float InverseStep;
+		float InverseAlbedo;
+		float InverseNormal;
+	};
+
+	// Rows are filtered in blocks of this many pixels; a fixed trip count lets the compiler vectorize the block's loop
+	// even under the cheap cost model of -O2, which won't vectorize loops that need a scalar remainder
+	constexpr int BLOCK = 8;
+
+	// Adds one tap of the kernel, Offset away, to the sums of Count pixels in a row starting at Center
+	// Count is rounded up to whole blocks, so the planes and sums need up to BLOCK - 1 floats of room past the row
+	// The planes and sums are restrict so the loop vectorizes without checking them against each other
+	void AccumulateTap(const Planes& In, size_t Center, ptrdiff_t Offset, int Count, float Kernel, const Falloff& Constants,
+		float* __restrict SumR, float* __restrict SumG, float* __restrict SumB, float* __restrict SumWeight)
+	{
+		const float* __restrict ColorR = In.Color[0] + Center;
+		const float* __restrict ColorG = In.Color[1] + Center;
+		const float* __restrict ColorB = In.Color[2] + Center;
+		const float* __restrict Luminance = In.Luminance + Center;
+		const float* __restrict Depth = In.Depth + Center;
+		const float* __restrict InverseDepth = In.InverseDepth + Center;
+		const float* __restrict NormalX = In.Normal[0] + Center;
+		const float* __restrict NormalY = In.Normal[1] + Center;
+		const float* __restrict NormalZ = In.Normal[2] + Center;
+		const float* __restrict AlbedoR = In.Albedo[0] + Center;
+		const float* __restrict AlbedoG = In.Albedo[1] + Center;
+		const float* __restrict AlbedoB = In.Albedo[2] + Center;
+		for (int Block = 0; Block < Count; Block += BLOCK)
+		{
+			for (int x = Block; x < Block + BLOCK; x++)
+			{
+				const ptrdiff_t t = x + Offset;
+				const float Nx = NormalX[x] - NormalX[t];
+				const float Ny = NormalY[x] - NormalY[t];
+				const float Nz = NormalZ[x] - NormalZ[t];
+				const float Lum = Luminance[x] - Luminance[t];
+				const float Ar = AlbedoR[x] - AlbedoR[t];
+				const float Ag = AlbedoG[x] - AlbedoG[t];
+				const float Ab = AlbedoB[x] - AlbedoB[t];
+				const float Exponent = Lum * Lum * Constants.InverseColor
+					+ std::abs(Depth[x] - Depth[t]) * InverseDepth[x] * Constants.InverseStep
+					+ (Ar * Ar + Ag * Ag + Ab * Ab) * Constants.InverseAlbedo
+					+ (Nx * Nx + Ny * Ny + Nz * Nz) * Constants.InverseNormal;
+				// All four terms share one exponential
+				const float Weight = Kernel * ShadingMath::ExpNegative(Exponent);
+				SumR[x] += Weight * ColorR[t];
+				SumG[x] += Weight * ColorG[t];
+				SumB[x] += Weight * ColorB[t];
+				SumWeight[x] += Weight;
+			}
+		}
+	}
+}
+
+void Denoiser::Apply(const DenoiseSettings& Settings, Framebuffer& Frame)
+{
+	const int Iterations = std::clamp(Settings.Iterations, 0, DenoiseSettings::MAX_ITERATIONS);
+	if (Iterations == 0)
+		return;
+	const int Width = Frame.Width;
+	const int Height = Frame.Height;
+	const int Padding = 2 << (Iterations - 1);
+	const size_t Stride = Width + 2 * size_t(Padding);
+	// The last row's taps read up to a block past the end
+	const size_t Size = Stride * (Height + 2 * size_t(Padding)) + BLOCK;
+	auto Index = [&](int x, int y) { return (size_t(y) + Padding) * Stride + x + Padding; };
+
+	for (int Channel = 0; Channel < 3; Channel++)
+	{
+		Color[Channel].assign(Size, 0.0f);
+		Filtered[Channel].assign(Size, 0.0f);
+		Normal[Channel].assign(Size, 0.0f);
+		Albedo[Channel].assign(Size, 0.0f);
+	}
+	Luminance.assign(Size, 0.0f);
+	Depth.assign(Size, PADDING_DEPTH);
+	InverseDepth.assign(Size, 0.0f);
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			const size_t i = size_t(y) * Width + x;
+			const size_t p = Index(x, y);
+			for (int Channel = 0; Channel < 3; Channel++)
+			{
+				Color[Channel][p] = Frame.Pixels[i][Channel];
+				Normal[Channel][p] = Frame.Normals[i][Channel];
+				Albedo[Channel][p] = Frame.Albedo[i][Channel];
+			}
+			Depth[p] = Frame.Depth[i] == std::numeric_limits<float>::max() ? BACKGROUND_DEPTH : Frame.Depth[i];
+			InverseDepth[p] = 1.0f / (Depth[p] * Settings.DepthSigma);
+		}
+	}
+
+	const size_t Ranges = Parallel::RangeCount(Height, 8);
+	for (int Pass = 0; Pass < Iterations; Pass++)
+	{
+		const int Step = 1 << Pass;
+		const float ColorSigma = Settings.ColorSigma / Step;
+		Falloff Constants;
+		Constants.InverseColor = 1.0f / (ColorSigma * ColorSigma);
+		Constants.InverseStep = 1.0f / Step;
+		Constants.InverseAlbedo = 1.0f / (Settings.AlbedoSigma * Settings.AlbedoSigma);
+		Constants.InverseNormal = 1.0f / (Settings.NormalSigma * Settings.NormalSigma);
+		const Planes In = {
+			{ Color[0].data(), Color[1].data(), Color[2].data() }, Luminance.data(), Depth.data(), InverseDepth.data(),
+			{ Normal[0].data(), Normal[1].data(), Normal[2].data() }, { Albedo[0].data(), Albedo[1].data(), Albedo[2].data() } };
+
+		// Luminance as displayed, with each channel remapped the way Drawing::DrawPixel does it, so the color term
+		// treats bright and dark parts of the image alike
+		Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t)
+		{
+			for (size_t y = Begin; y < End; y++)
+			{
+				const size_t Row = Index(0, static_cast<int>(y));
+				for (size_t p = Row; p < Row + Width; p++)
+					Luminance[p] = Drawing::DisplayLuminance(color4(Color[0][p], Color[1][p], Color[2][p], 1.0f));
+			}
+		});
+
+		Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t)
+		{
+			// Rounded up to whole blocks; the sums past the row are worked out and thrown away
+			const size_t SumWidth = (size_t(Width) + BLOCK - 1) / BLOCK * BLOCK;
+			std::vector<float> Sums(4 * SumWidth);
+			float* SumR = Sums.data();
+			float* SumG = SumR + SumWidth;
+			float* SumB = SumG + SumWidth;
+			float* SumWeight = SumB + SumWidth;
+			for (size_t y = Begin; y < End; y++)
+			{
+				std::fill(Sums.begin(), Sums.end(), 0.0f);
+				const size_t Row = Index(0, static_cast<int>(y));
+
+				// One tap at a time over the whole row, so the loop runs over contiguous floats
+				for (int ty = 0; ty < 5; ty++)
+				{
+					for (int tx = 0; tx < 5; tx++)
+					{
+						if (tx != 2 || ty != 2)
+						{
+							const ptrdiff_t Offset = ((ty - 2) * ptrdiff_t(Stride) + (tx - 2)) * Step;
+							AccumulateTap(In, Row, Offset, Width, KERNEL[tx] * KERNEL[ty], Constants, SumR, SumG, SumB, SumWeight);
+						}
+					}
+				}
+
+				// The pixel itself always counts fully, which keeps the background and isolated pixels as they are
+				constexpr float CENTER = KERNEL[2] * KERNEL[2];
+				for (int x = 0; x < Width; x++)
+				{
+					const float Normalize = 1.0f / (SumWeight[x] + CENTER);
+					Filtered[0][Row + x] = (SumR[x] + CENTER * Color[0][Row + x]) * Normalize;
+					Filtered[1][Row + x] = (SumG[x] + CENTER * Color[1][Row + x]) * Normalize;
+					Filtered[2][Row + x] = (SumB[x] + CENTER * Color[2][Row + x]) * Normalize;
+				}
+			}
+		});
+		for (int Channel = 0; Channel < 3; Channel++)
+			Color[Channel].swap(Filtered[Channel]);
+	}
+
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			const size_t p = Index(x, y);
+			for (int Channel = 0; Channel < 3; Channel++)
+				Frame.At(x, y)[Channel] = Color[Channel][p];
+		}
+	}
+}
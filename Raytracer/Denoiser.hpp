@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+
+#include "Raytracer.hpp"
+#include "Rendering.hpp"
+
+// Edge-avoiding à-trous wavelet filter (Dammertz et al., "Edge-Avoiding À-Trous Wavelet Transform for fast Global
+// Illumination Filtering"); blurs noise away in passes of a 5x5 kernel whose taps spread twice as far every pass,
+// weighing every tap by how much its depth, normal, albedo and luminance differ from the pixel's
+// The background is left untouched
+class Denoiser
+{
+public:
+	// Filters Frame.Pixels in place, guided by Frame.Depth, Frame.Normals and Frame.Albedo
+	void Apply(const DenoiseSettings& Settings, Framebuffer& Frame);
+
+private:
+	// One plane per channel, padded on every side by the widest reach of the kernel, so the inner loops run
+	// over contiguous floats without bounds checks; padding has zero weight
+	std::vector<float> Color[3]{};
+	std::vector<float> Filtered[3]{};
+	std::vector<float> Luminance{};
+	std::vector<float> Depth{};
+	// 1 / (depth * DepthSigma), so the depth term needs no division per tap
+	std::vector<float> InverseDepth{};
+	std::vector<float> Normal[3]{};
+	std::vector<float> Albedo[3]{};
+};
@@ -19,19 +19,7 @@ namespace Drawing
 			return;
 		}
 		
-		auto Remap = [](float Value)
-		{
-			return Value / (Value + 1.0f);
-		};
-		SDL_SetRenderDrawColor(Renderer, Remap(Color.r) * 255, Remap(Color.g) * 255, Remap(Color.b) * 255, Color.a * 255);
+		SDL_SetRenderDrawColor(Renderer, DisplayValue(Color.r) * 255, DisplayValue(Color.g) * 255, DisplayValue(Color.b) * 255, Color.a * 255);
 		SDL_RenderPoint(Renderer, x, y);
 	}
-
-	vec3 CanvasToViewport(ivec2 CanvasPos) 
-	{
-		return vec3(
-			CanvasPos.x * (static_cast<float>(ViewportWidth) / ResX), 
-			-CanvasPos.y * (static_cast<float>(ViewportHeight) / ResY), 
-			ViewportDistanceFromCamera);
-	}
 }
\ No newline at end of file
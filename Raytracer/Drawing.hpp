@@ -23,11 +23,17 @@ namespace Drawing
 	constexpr int ResX = 400;
 	constexpr int ResY = 400;
 
-    constexpr int ViewportWidth = 1;
-    constexpr int ViewportHeight = 1;
-    constexpr int ViewportDistanceFromCamera = 1;
+	// A linear color channel remapped as v / (v + 1) onto [0, 1), the way pixels are displayed
+	inline float DisplayValue(float Value)
+	{
+		return Value / (Value + 1.0f);
+	}
 
-	void DrawPixel(SDL_Renderer* Renderer, int x, int y, color4 Color);
+	// Brightness as displayed, from each channel after DisplayValue
+	inline float DisplayLuminance(const color4& Color)
+	{
+		return 0.2126f * DisplayValue(Color.r) + 0.7152f * DisplayValue(Color.g) + 0.0722f * DisplayValue(Color.b);
+	}
 
-    vec3 CanvasToViewport(ivec2 CanvasPos);
+	void DrawPixel(SDL_Renderer* Renderer, int x, int y, color4 Color);
 }
@@ -0,0 +1,102 @@
+#include <bit>
+#include <cmath>
+
+#include "Grid.hpp"
+#include "Parallel.hpp"
+
+void UniformGrid::Build(const std::vector<AABB>& PrimitiveBounds)
+{
+	Primitives = PrimitiveBounds.size();
+	GridBounds = AABB();
+	CellStart.clear();
+	CellPrimitives.clear();
+	if (Primitives == 0)
+		return;
+
+	// Grid bounds, reduced across threads
+	const size_t Ranges = Parallel::RangeCount(Primitives, 1 << 14);
+	std::vector<AABB> RangeBounds(Ranges);
+	Parallel::ForRanges(Primitives, Ranges, [&](size_t Begin, size_t End, size_t Range)
+	{
+		for (size_t i = Begin; i < End; i++)
+			RangeBounds[Range].Grow(PrimitiveBounds[i]);
+	});
+	for (const AABB& Bounds : RangeBounds)
+		GridBounds.Grow(Bounds);
+
+	// Roughly cubic cells, sized so there are about CELLS_PER_PRIMITIVE of them per primitive
+	// Flat axes get a sliver of thickness so the volume doesn't vanish
+	vec3 Extent = GridBounds.Max - GridBounds.Min;
+	const float Largest = std::max(std::max(Extent.x, Extent.y), std::max(Extent.z, 1e-6f));
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		if (Extent[Axis] < Largest * 1e-3f)
+		{
+			GridBounds.Min[Axis] -= Largest * 1e-3f;
+			GridBounds.Max[Axis] += Largest * 1e-3f;
+			Extent[Axis] = GridBounds.Max[Axis] - GridBounds.Min[Axis];
+		}
+	}
+	const float CellSide = std::cbrt(Extent.x * Extent.y * Extent.z / (CELLS_PER_PRIMITIVE * Primitives));
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		Resolution[Axis] = std::clamp(static_cast<int>(std::ceil(Extent[Axis] / CellSide)), 1, MAX_RESOLUTION);
+		CellSize[Axis] = Extent[Axis] / Resolution[Axis];
+		InvCellSize[Axis] = 1.0f / CellSize[Axis];
+	}
+	const size_t CellCount = size_t(Resolution[0]) * Resolution[1] * Resolution[2];
+
+	// Calls Fn(Cell) for every cell a primitive's box overlaps
+	auto ForEachCell = [this](const AABB& Bounds, auto&& Fn)
+	{
+		int Low[3];
+		int High[3];
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			Low[Axis] = std::clamp(static_cast<int>((Bounds.Min[Axis] - GridBounds.Min[Axis]) * InvCellSize[Axis]), 0, Resolution[Axis] - 1);
+			High[Axis] = std::clamp(static_cast<int>((Bounds.Max[Axis] - GridBounds.Min[Axis]) * InvCellSize[Axis]), 0, Resolution[Axis] - 1);
+		}
+		for (int z = Low[2]; z <= High[2]; z++)
+		{
+			for (int y = Low[1]; y <= High[1]; y++)
+			{
+				for (int x = Low[0]; x <= High[0]; x++)
+					Fn(x + Resolution[0] * (y + Resolution[1] * z));
+			}
+		}
+	};
+
+	// One (cell, primitive) pair per overlap, written in primitive order, then radix sorted by cell
+	// Unlike scattering straight into cells, every pass walks memory in order
+	std::vector<uint32_t> PairStart(Primitives + 1);
+	Parallel::For(Primitives, [&](size_t i)
+	{
+		uint32_t Count = 0;
+		ForEachCell(PrimitiveBounds[i], [&](int) { Count++; });
+		PairStart[i + 1] = Count;
+	});
+	for (size_t i = 0; i < Primitives; i++)
+		PairStart[i + 1] += PairStart[i];
+
+	std::vector<uint32_t> PairCells(PairStart[Primitives]);
+	CellPrimitives.resize(PairStart[Primitives]);
+	Parallel::For(Primitives, [&](size_t i)
+	{
+		uint32_t Pair = PairStart[i];
+		ForEachCell(PrimitiveBounds[i], [&](int Cell)
+		{
+			PairCells[Pair] = static_cast<uint32_t>(Cell);
+			CellPrimitives[Pair++] = static_cast<uint32_t>(i);
+		});
+	});
+	Parallel::RadixSort(PairCells, CellPrimitives, static_cast<int>(std::bit_width(CellCount)));
+
+	// The sort is stable, so each cell's primitives stay in index order and traversal is deterministic
+	CellStart.assign(CellCount + 1, 0);
+	for (uint32_t Pair = 0, Cell = 0; Cell <= CellCount; Cell++)
+	{
+		while (Pair < PairCells.size() && PairCells[Pair] < Cell)
+			Pair++;
+		CellStart[Cell] = Pair;
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "BVH.hpp"
+#include "VecUtils.hpp"
+
+// Uniform grid over anything that can be bounded; an alternative to the BVH that builds faster
+// for many similarly sized primitives, at the cost of traversal speed on uneven scenes
+// Every cell lists the primitives whose boxes overlap it; like the BVH it only stores primitive indices
+class UniformGrid
+{
+public:
+	// Full rebuild over one box per primitive, spread over all threads
+	void Build(const std::vector<AABB>& PrimitiveBounds);
+
+	// A grid has no topology worth keeping, so refitting is a rebuild
+	void Refit(const std::vector<AABB>& PrimitiveBounds) { Build(PrimitiveBounds); }
+
+	// Always rebuilds; returns true like BVH::Update does when it rebuilt
+	bool Update(const std::vector<AABB>& PrimitiveBounds)
+	{
+		Build(PrimitiveBounds);
+		return true;
+	}
+
+	bool Empty() const { return CellStart.empty(); }
+	size_t PrimitiveCount() const { return Primitives; }
+	size_t MemoryUsage() const { return (CellStart.size() + CellPrimitives.size()) * sizeof(uint32_t); }
+	const AABB& Bounds() const { return GridBounds; }
+
+	// Same contract as BVH::Traverse: calls IntersectPrimitive(Index, TMax) for the primitives in every cell
+	// the ray passes through before TMax, nearest cell first, and stops early when it returns true
+	// Primitives spanning several cells can be offered more than once
+	template <typename Fn>
+	void Traverse(const vec3& Origin, const vec3& InvDirection, float TMin, float& TMax, Fn&& IntersectPrimitive) const
+	{
+		if (Empty())
+			return;
+		const float tEnter = GridBounds.Intersect(Origin, InvDirection, TMin, TMax);
+		if (tEnter == std::numeric_limits<float>::max())
+			return;
+
+		// 3D-DDA (Amanatides & Woo) from the cell where the ray enters the grid
+		int Cell[3];
+		int Step[3];
+		int End[3];
+		float tNext[3];
+		float tDelta[3];
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			const float Entry = Origin[Axis] + tEnter / InvDirection[Axis];
+			Cell[Axis] = std::clamp(static_cast<int>((Entry - GridBounds.Min[Axis]) * InvCellSize[Axis]), 0, Resolution[Axis] - 1);
+			const bool Positive = InvDirection[Axis] >= 0.0f;
+			Step[Axis] = Positive ? 1 : -1;
+			End[Axis] = Positive ? Resolution[Axis] : -1;
+			tNext[Axis] = (GridBounds.Min[Axis] + (Cell[Axis] + (Positive ? 1 : 0)) * CellSize[Axis] - Origin[Axis]) * InvDirection[Axis];
+			tDelta[Axis] = CellSize[Axis] * std::abs(InvDirection[Axis]);
+		}
+
+		while (true)
+		{
+			const uint32_t Index = Cell[0] + Resolution[0] * (Cell[1] + Resolution[1] * Cell[2]);
+			for (uint32_t i = CellStart[Index]; i < CellStart[Index + 1]; i++)
+			{
+				if (IntersectPrimitive(CellPrimitives[i], TMax))
+					return;
+			}
+
+			// A hit inside this cell beats anything the following cells can hold
+			const int Axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+			if (TMax <= tNext[Axis])
+				return;
+			Cell[Axis] += Step[Axis];
+			if (Cell[Axis] == End[Axis])
+				return;
+			tNext[Axis] += tDelta[Axis];
+		}
+	}
+
+	// Calls Fn(Index) for every primitive whose box overlaps the cell holding Point, or for none if Point is outside the grid
+	// Only as precise as the cells, so callers still have to test the primitives themselves
+	template <typename Fn>
+	void ForEachAt(const vec3& Point, Fn&& Visit) const
+	{
+		if (Empty())
+			return;
+		int Cell[3];
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			if (Point[Axis] < GridBounds.Min[Axis] || Point[Axis] > GridBounds.Max[Axis])
+				return;
+			Cell[Axis] = std::min(static_cast<int>((Point[Axis] - GridBounds.Min[Axis]) * InvCellSize[Axis]), Resolution[Axis] - 1);
+		}
+		const uint32_t Index = Cell[0] + Resolution[0] * (Cell[1] + Resolution[1] * Cell[2]);
+		for (uint32_t i = CellStart[Index]; i < CellStart[Index + 1]; i++)
+			Visit(CellPrimitives[i]);
+	}
+
+	// The resolution aims for this many cells per primitive
+	static constexpr float CELLS_PER_PRIMITIVE = 2.0f;
+	// Upper limit on cells along any one axis
+	static constexpr int MAX_RESOLUTION = 512;
+
+private:
+	AABB GridBounds{};
+	vec3 CellSize = vec3(0, 0, 0);
+	vec3 InvCellSize = vec3(0, 0, 0);
+	int Resolution[3] = {};
+	size_t Primitives = 0;
+	// Cell i holds CellPrimitives[CellStart[i]] up to CellPrimitives[CellStart[i + 1]]
+	std::vector<uint32_t> CellStart{};
+	std::vector<uint32_t> CellPrimitives{};
+};
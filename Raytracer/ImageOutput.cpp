@@ -0,0 +1,707 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+
+#include "Drawing.hpp"
+#include "ImageOutput.hpp"
+#include "Parallel.hpp"
+
+namespace {
+	// 8 bit RGB, as Drawing::DrawPixel shows it
+	std::vector<uint8_t> DisplayBytes(const std::vector<color4>& Pixels)
+	{
+		std::vector<uint8_t> Bytes(Pixels.size() * 3);
+		auto Remap = [](float Value) { return static_cast<uint8_t>(Drawing::DisplayValue(Value) * 255); };
+		for (size_t i = 0; i < Pixels.size(); i++)
+		{
+			Bytes[3 * i] = Remap(Pixels[i].r);
+			Bytes[3 * i + 1] = Remap(Pixels[i].g);
+			Bytes[3 * i + 2] = Remap(Pixels[i].b);
+		}
+		return Bytes;
+	}
+
+	void StoreBigEndian32(uint8_t* To, uint32_t Value)
+	{
+		for (int i = 0; i < 4; i++)
+			To[i] = uint8_t(Value >> (24 - 8 * i));
+	}
+
+	void AppendBigEndian32(std::vector<uint8_t>& Out, uint32_t Value)
+	{
+		Out.resize(Out.size() + 4);
+		StoreBigEndian32(Out.data() + Out.size() - 4, Value);
+	}
+
+	void StoreLittleEndian(uint8_t* To, uint64_t Value, int Bytes)
+	{
+		for (int i = 0; i < Bytes; i++)
+			To[i] = uint8_t(Value >> (8 * i));
+	}
+
+	void AppendLittleEndian(std::vector<uint8_t>& Out, uint64_t Value, int Bytes)
+	{
+		Out.resize(Out.size() + Bytes);
+		StoreLittleEndian(Out.data() + Out.size() - Bytes, Value, Bytes);
+	}
+
+	// Deflate (RFC 1951) fills each byte from its least significant bit up
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::vector<uint8_t>& Out) : Out(Out) {}
+
+		void Write(uint32_t Value, int Count)
+		{
+			Buffer |= uint64_t(Value) << Used;
+			Used += Count;
+			while (Used >= 8)
+			{
+				Out.push_back(uint8_t(Buffer));
+				Buffer >>= 8;
+				Used -= 8;
+			}
+		}
+
+		void AlignToByte()
+		{
+			if (Used > 0)
+				Write(0, 8 - Used);
+		}
+
+	private:
+		std::vector<uint8_t>& Out;
+		uint64_t Buffer = 0;
+		int Used = 0;
+	};
+
+	// Canonical Huffman code with lengths of at most MaxBits, as deflate describes them
+	struct HuffmanCode
+	{
+		std::vector<uint8_t> Lengths{};
+		// Bit reversed, so BitWriter sends them most significant bit first as deflate wants
+		std::vector<uint16_t> Codes{};
+
+		void Build(const std::vector<uint32_t>& Frequencies, int MaxBits)
+		{
+			const uint32_t Count = static_cast<uint32_t>(Frequencies.size());
+			std::vector<uint32_t> Weights = Frequencies;
+			// Decoders want at least two codes
+			uint32_t Used = static_cast<uint32_t>(std::count_if(Weights.begin(), Weights.end(), [](uint32_t w) { return w > 0; }));
+			for (uint32_t i = 0; Used < 2 && i < Count; i++)
+			{
+				if (Weights[i] == 0)
+				{
+					Weights[i] = 1;
+					Used++;
+				}
+			}
+
+			// Huffman tree, with nodes past Count joining two others; when it comes out too deep the weights are
+			// halved, which evens them out, until it fits
+			using Node = std::pair<uint64_t, uint32_t>;
+			std::vector<uint32_t> Parent(2 * Count);
+			std::vector<int> Depth(2 * Count);
+			while (true)
+			{
+				std::priority_queue<Node, std::vector<Node>, std::greater<Node>> Queue;
+				for (uint32_t i = 0; i < Count; i++)
+				{
+					if (Weights[i] > 0)
+						Queue.push({ Weights[i], i });
+				}
+				uint32_t Next = Count;
+				while (Queue.size() > 1)
+				{
+					const Node a = Queue.top();
+					Queue.pop();
+					const Node b = Queue.top();
+					Queue.pop();
+					Parent[a.second] = Parent[b.second] = Next;
+					Queue.push({ a.first + b.first, Next++ });
+				}
+
+				// Parents always come after their children, so walking down from the root sees them first
+				int Longest = 0;
+				Depth[Next - 1] = 0;
+				for (uint32_t n = Next - 1; n-- > 0;)
+				{
+					if (n >= Count || Weights[n] > 0)
+					{
+						Depth[n] = Depth[Parent[n]] + 1;
+						Longest = std::max(Longest, Depth[n]);
+					}
+				}
+				if (Longest <= MaxBits)
+					break;
+				for (uint32_t& w : Weights)
+					w = (w + 1) / 2;
+			}
+
+			Lengths.assign(Count, 0);
+			std::array<uint32_t, 16> LengthCounts{};
+			for (uint32_t i = 0; i < Count; i++)
+			{
+				if (Weights[i] > 0)
+				{
+					Lengths[i] = static_cast<uint8_t>(Depth[i]);
+					LengthCounts[Lengths[i]]++;
+				}
+			}
+
+			// Codes of each length count up from where the shorter ones left off
+			std::array<uint32_t, 16> NextCode{};
+			uint32_t Code = 0;
+			for (int Bits = 1; Bits <= 15; Bits++)
+			{
+				Code = (Code + LengthCounts[Bits - 1]) << 1;
+				NextCode[Bits] = Code;
+			}
+			Codes.assign(Count, 0);
+			for (uint32_t i = 0; i < Count; i++)
+			{
+				if (Lengths[i] == 0)
+					continue;
+				uint32_t Forward = NextCode[Lengths[i]]++;
+				uint32_t Reversed = 0;
+				for (int Bit = 0; Bit < Lengths[i]; Bit++, Forward >>= 1)
+					Reversed = (Reversed << 1) | (Forward & 1);
+				Codes[i] = static_cast<uint16_t>(Reversed);
+			}
+		}
+
+		void Write(BitWriter& Bits, uint32_t Symbol) const
+		{
+			Bits.Write(Codes[Symbol], Lengths[Symbol]);
+		}
+	};
+
+	constexpr uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	constexpr uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	constexpr uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	constexpr uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	// Index of the last base that isn't above Value
+	template <size_t N>
+	uint32_t BaseSymbol(const uint16_t (&Bases)[N], uint32_t Value)
+	{
+		return static_cast<uint32_t>(std::upper_bound(Bases, Bases + N, Value) - Bases - 1);
+	}
+
+	// A literal byte, or a match of Length bytes Distance back
+	struct Token
+	{
+		uint16_t LengthOrLiteral;
+		uint16_t Distance;
+	};
+
+	constexpr int WINDOW_SIZE = 32768;
+	constexpr int MIN_MATCH = 3;
+	constexpr int MAX_MATCH = 258;
+	constexpr int HASH_BITS = 15;
+	// Candidates tried per position; longer chains find longer matches, slowly
+	constexpr int MAX_CHAIN = 32;
+
+	// Greedy LZ77 over hash chains of every position's first three bytes
+	std::vector<Token> FindMatches(const uint8_t* Data, size_t Size)
+	{
+		std::vector<Token> Tokens;
+		Tokens.reserve(Size / 2);
+		std::vector<int32_t> Head(size_t(1) << HASH_BITS, -1);
+		std::vector<int32_t> Previous(WINDOW_SIZE, -1);
+		auto Hash = [&](size_t i)
+		{
+			return ((uint32_t(Data[i]) << 16 | uint32_t(Data[i + 1]) << 8 | Data[i + 2]) * 2654435761u) >> (32 - HASH_BITS);
+		};
+		auto Insert = [&](size_t i)
+		{
+			const uint32_t h = Hash(i);
+			Previous[i & (WINDOW_SIZE - 1)] = Head[h];
+			Head[h] = static_cast<int32_t>(i);
+		};
+
+		size_t i = 0;
+		while (i < Size)
+		{
+			size_t BestLength = 0;
+			size_t BestDistance = 0;
+			if (i + MIN_MATCH <= Size)
+			{
+				const size_t Limit = std::min<size_t>(MAX_MATCH, Size - i);
+				int32_t Candidate = Head[Hash(i)];
+				for (int Chain = 0; Candidate >= 0 && i - Candidate <= WINDOW_SIZE && Chain < MAX_CHAIN; Chain++)
+				{
+					// Only a match that gets past the best one so far is worth comparing in full
+					if (Data[Candidate + BestLength] == Data[i + BestLength])
+					{
+						size_t Length = 0;
+						while (Length < Limit && Data[Candidate + Length] == Data[i + Length])
+							Length++;
+						if (Length > BestLength)
+						{
+							BestLength = Length;
+							BestDistance = i - Candidate;
+							if (Length == Limit)
+								break;
+						}
+					}
+					Candidate = Previous[Candidate & (WINDOW_SIZE - 1)];
+				}
+				Insert(i);
+			}
+
+			if (BestLength >= MIN_MATCH)
+			{
+				Tokens.push_back({ static_cast<uint16_t>(BestLength), static_cast<uint16_t>(BestDistance) });
+				for (size_t j = i + 1; j < i + BestLength && j + MIN_MATCH <= Size; j++)
+					Insert(j);
+				i += BestLength;
+			}
+			else
+			{
+				Tokens.push_back({ Data[i], 0 });
+				i++;
+			}
+		}
+		return Tokens;
+	}
+
+	// Appends Data as one block with Huffman codes of its own. Unless it is the final block, an empty stored block
+	// follows, which brings the stream to a byte boundary so the next block can be deflated separately and appended
+	void Deflate(const uint8_t* Data, size_t Size, bool Final, std::vector<uint8_t>& Out)
+	{
+		const std::vector<Token> Tokens = FindMatches(Data, Size);
+		std::vector<uint32_t> LiteralCounts(286);
+		std::vector<uint32_t> DistanceCounts(30);
+		for (const Token& t : Tokens)
+		{
+			if (t.Distance == 0)
+			{
+				LiteralCounts[t.LengthOrLiteral]++;
+				continue;
+			}
+			LiteralCounts[257 + BaseSymbol(LENGTH_BASE, t.LengthOrLiteral)]++;
+			DistanceCounts[BaseSymbol(DISTANCE_BASE, t.Distance)]++;
+		}
+		LiteralCounts[256] = 1;
+		HuffmanCode Literals;
+		HuffmanCode Distances;
+		Literals.Build(LiteralCounts, 15);
+		Distances.Build(DistanceCounts, 15);
+
+		// Both codes' lengths go in front of the block, run length encoded: 16 repeats the last length 3-6 times,
+		// 17 and 18 give 3-10 and 11-138 zeros
+		int LiteralCodes = 286;
+		while (LiteralCodes > 257 && Literals.Lengths[LiteralCodes - 1] == 0)
+			LiteralCodes--;
+		int DistanceCodes = 30;
+		while (DistanceCodes > 1 && Distances.Lengths[DistanceCodes - 1] == 0)
+			DistanceCodes--;
+		std::vector<uint8_t> Lengths(Literals.Lengths.begin(), Literals.Lengths.begin() + LiteralCodes);
+		Lengths.insert(Lengths.end(), Distances.Lengths.begin(), Distances.Lengths.begin() + DistanceCodes);
+
+		struct Run
+		{
+			uint8_t Symbol;
+			uint8_t Extra;
+		};
+		std::vector<Run> Runs;
+		for (size_t i = 0; i < Lengths.size();)
+		{
+			const uint8_t Length = Lengths[i];
+			size_t Repeats = 1;
+			while (i + Repeats < Lengths.size() && Lengths[i + Repeats] == Length)
+				Repeats++;
+			i += Repeats;
+
+			if (Length == 0)
+			{
+				for (; Repeats >= 11; Repeats -= std::min<size_t>(Repeats, 138))
+					Runs.push_back({ 18, static_cast<uint8_t>(std::min<size_t>(Repeats, 138) - 11) });
+				if (Repeats >= 3)
+				{
+					Runs.push_back({ 17, static_cast<uint8_t>(Repeats - 3) });
+					Repeats = 0;
+				}
+			}
+			else
+			{
+				Runs.push_back({ Length, 0 });
+				for (Repeats--; Repeats >= 3; Repeats -= std::min<size_t>(Repeats, 6))
+					Runs.push_back({ 16, static_cast<uint8_t>(std::min<size_t>(Repeats, 6) - 3) });
+			}
+			for (; Repeats > 0; Repeats--)
+				Runs.push_back({ Length, 0 });
+		}
+		std::vector<uint32_t> RunCounts(19);
+		for (const Run& r : Runs)
+			RunCounts[r.Symbol]++;
+		HuffmanCode LengthCode;
+		LengthCode.Build(RunCounts, 7);
+		constexpr uint8_t LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int LengthCodes = 19;
+		while (LengthCodes > 4 && LengthCode.Lengths[LENGTH_ORDER[LengthCodes - 1]] == 0)
+			LengthCodes--;
+
+		BitWriter Bits(Out);
+		Bits.Write(Final ? 1 : 0, 1);
+		Bits.Write(2, 2);
+		Bits.Write(LiteralCodes - 257, 5);
+		Bits.Write(DistanceCodes - 1, 5);
+		Bits.Write(LengthCodes - 4, 4);
+		for (int i = 0; i < LengthCodes; i++)
+			Bits.Write(LengthCode.Lengths[LENGTH_ORDER[i]], 3);
+		for (const Run& r : Runs)
+		{
+			LengthCode.Write(Bits, r.Symbol);
+			if (r.Symbol >= 16)
+				Bits.Write(r.Extra, r.Symbol == 16 ? 2 : r.Symbol == 17 ? 3 : 7);
+		}
+
+		for (const Token& t : Tokens)
+		{
+			if (t.Distance == 0)
+			{
+				Literals.Write(Bits, t.LengthOrLiteral);
+				continue;
+			}
+			const uint32_t LengthSymbol = BaseSymbol(LENGTH_BASE, t.LengthOrLiteral);
+			Literals.Write(Bits, 257 + LengthSymbol);
+			Bits.Write(t.LengthOrLiteral - LENGTH_BASE[LengthSymbol], LENGTH_EXTRA[LengthSymbol]);
+			const uint32_t DistanceSymbol = BaseSymbol(DISTANCE_BASE, t.Distance);
+			Distances.Write(Bits, DistanceSymbol);
+			Bits.Write(t.Distance - DISTANCE_BASE[DistanceSymbol], DISTANCE_EXTRA[DistanceSymbol]);
+		}
+		Literals.Write(Bits, 256);
+
+		if (!Final)
+			Bits.Write(0, 3);
+		Bits.AlignToByte();
+		if (!Final)
+			Out.insert(Out.end(), { 0x00, 0x00, 0xFF, 0xFF });
+	}
+
+	constexpr uint32_t ADLER_MODULUS = 65521;
+
+	uint32_t Adler32(const uint8_t* Data, size_t Size)
+	{
+		uint32_t a = 1;
+		uint32_t b = 0;
+		while (Size > 0)
+		{
+			// The most bytes that can be summed before b could overflow
+			const size_t Chunk = std::min<size_t>(Size, 5552);
+			for (size_t i = 0; i < Chunk; i++)
+			{
+				a += Data[i];
+				b += a;
+			}
+			a %= ADLER_MODULUS;
+			b %= ADLER_MODULUS;
+			Data += Chunk;
+			Size -= Chunk;
+		}
+		return b << 16 | a;
+	}
+
+	// Adler-32 of two pieces of data one after the other, from theirs and the second one's size (as zlib's adler32_combine)
+	uint32_t CombineAdler32(uint32_t First, uint32_t Second, size_t SecondSize)
+	{
+		const uint32_t Remainder = static_cast<uint32_t>(SecondSize % ADLER_MODULUS);
+		uint32_t a = First & 0xFFFF;
+		uint32_t b = static_cast<uint32_t>((uint64_t(Remainder) * a) % ADLER_MODULUS);
+		a += (Second & 0xFFFF) + ADLER_MODULUS - 1;
+		b += (First >> 16) + (Second >> 16) + ADLER_MODULUS - Remainder;
+		a %= ADLER_MODULUS;
+		b %= ADLER_MODULUS;
+		return b << 16 | a;
+	}
+
+	constexpr std::array<uint32_t, 256> CRC_TABLE = []
+	{
+		std::array<uint32_t, 256> Table{};
+		for (uint32_t n = 0; n < 256; n++)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			Table[n] = c;
+		}
+		return Table;
+	}();
+
+	uint32_t Crc32(const uint8_t* Data, size_t Size)
+	{
+		uint32_t c = 0xFFFFFFFFu;
+		for (size_t i = 0; i < Size; i++)
+			c = CRC_TABLE[(c ^ Data[i]) & 0xFF] ^ (c >> 8);
+		return c ^ 0xFFFFFFFFu;
+	}
+
+	// Length, type, data, and the CRC of type and data
+	void AppendChunk(std::vector<uint8_t>& Out, const char* Type, const std::vector<uint8_t>& Data)
+	{
+		AppendBigEndian32(Out, static_cast<uint32_t>(Data.size()));
+		const size_t Start = Out.size();
+		Out.insert(Out.end(), Type, Type + 4);
+		Out.insert(Out.end(), Data.begin(), Data.end());
+		AppendBigEndian32(Out, Crc32(Out.data() + Start, Out.size() - Start));
+	}
+
+	uint8_t Paeth(int a, int b, int c)
+	{
+		const int p = a + b - c;
+		const int pa = std::abs(p - a);
+		const int pb = std::abs(p - b);
+		const int pc = std::abs(p - c);
+		return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+	}
+
+	// Writes the filter byte and the filtered row to Out, picking whichever of the five PNG filters leaves the
+	// smallest sum of absolute values; Above is all zeros on the first row, and Scratch holds 5 rows
+	void FilterRow(const uint8_t* Row, const uint8_t* Above, size_t Stride, uint8_t* Scratch, uint8_t* Out)
+	{
+		constexpr size_t PIXEL_SIZE = 3;
+		uint64_t BestScore = UINT64_MAX;
+		int Best = 0;
+		// Each filter gets a loop of its own, predicting from the bytes to the left (a), above (b) and above left (c)
+		auto Apply = [&](int Filter, auto&& Predict)
+		{
+			uint8_t* Filtered = Scratch + Filter * Stride;
+			uint64_t Score = 0;
+			for (size_t x = 0; x < Stride; x++)
+			{
+				const int a = x >= PIXEL_SIZE ? Row[x - PIXEL_SIZE] : 0;
+				const int c = x >= PIXEL_SIZE ? Above[x - PIXEL_SIZE] : 0;
+				Filtered[x] = static_cast<uint8_t>(Row[x] - Predict(a, Above[x], c));
+				Score += std::abs(static_cast<int8_t>(Filtered[x]));
+			}
+			if (Score < BestScore)
+			{
+				BestScore = Score;
+				Best = Filter;
+			}
+		};
+		Apply(0, [](int, int, int) { return 0; });
+		Apply(1, [](int a, int, int) { return a; });
+		Apply(2, [](int, int b, int) { return b; });
+		Apply(3, [](int a, int b, int) { return (a + b) / 2; });
+		Apply(4, [](int a, int b, int c) { return Paeth(a, b, c); });
+		Out[0] = static_cast<uint8_t>(Best);
+		std::copy(Scratch + Best * Stride, Scratch + (Best + 1) * Stride, Out + 1);
+	}
+
+	// Rounds to the nearest half, ties to even; too large values become infinity (Fabian Giesen's float_to_half_fast3_rtne)
+	uint16_t FloatToHalf(float Value)
+	{
+		uint32_t Bits = std::bit_cast<uint32_t>(Value);
+		const uint32_t Sign = Bits & 0x80000000u;
+		Bits ^= Sign;
+		uint32_t Half;
+		if (Bits >= (127 + 16) << 23)
+		{
+			// Infinity stays infinity and NaN stays NaN
+			Half = Bits > 255u << 23 ? 0x7E00 : 0x7C00;
+		}
+		else if (Bits < 113 << 23)
+		{
+			// Subnormal or zero; adding this lines the mantissa up with the half's and lets the float addition round it
+			constexpr uint32_t DENORMAL_MAGIC = ((127 - 15) + (23 - 10) + 1) << 23;
+			Half = std::bit_cast<uint32_t>(std::bit_cast<float>(Bits) + std::bit_cast<float>(DENORMAL_MAGIC)) - DENORMAL_MAGIC;
+		}
+		else
+		{
+			const uint32_t MantissaOdd = (Bits >> 13) & 1;
+			Bits += ((15 - 127) << 23) + 0xFFF + MantissaOdd;
+			Half = Bits >> 13;
+		}
+		return static_cast<uint16_t>(Half | Sign >> 16);
+	}
+}
+
+namespace ImageOutput
+{
+	std::vector<uint8_t> EncodePPM(const std::vector<color4>& Pixels, int Width, int Height)
+	{
+		const std::string Header = "P6\n" + std::to_string(Width) + " " + std::to_string(Height) + "\n255\n";
+		std::vector<uint8_t> Out(Header.begin(), Header.end());
+		const std::vector<uint8_t> Bytes = DisplayBytes(Pixels);
+		Out.insert(Out.end(), Bytes.begin(), Bytes.end());
+		return Out;
+	}
+
+	std::vector<uint8_t> EncodePNG(const std::vector<color4>& Pixels, int Width, int Height, int RowsPerBlock)
+	{
+		const std::vector<uint8_t> Image = DisplayBytes(Pixels);
+		const size_t Stride = size_t(Width) * 3;
+		RowsPerBlock = std::max(RowsPerBlock, 1);
+		const size_t BlockCount = std::max<size_t>((Height + RowsPerBlock - 1) / RowsPerBlock, 1);
+
+		// Every block becomes an IDAT chunk of its own, all but the length and CRC filled in on its own thread; the
+		// zlib stream's header goes in the first and its Adler-32 in the last
+		struct Block
+		{
+			std::vector<uint8_t> Chunk{};
+			uint32_t Adler = 1;
+			size_t Size = 0;
+		};
+		std::vector<Block> Blocks(BlockCount);
+		Parallel::For(BlockCount, [&](size_t b)
+		{
+			const int First = static_cast<int>(b) * RowsPerBlock;
+			const int Last = std::min(Height, First + RowsPerBlock);
+			std::vector<uint8_t> Filtered(size_t(Last - First) * (Stride + 1));
+			std::vector<uint8_t> Scratch(5 * Stride);
+			const std::vector<uint8_t> Zeros(First == 0 ? Stride : 0);
+			for (int y = First; y < Last; y++)
+			{
+				const uint8_t* Row = Image.data() + y * Stride;
+				FilterRow(Row, y > 0 ? Row - Stride : Zeros.data(), Stride, Scratch.data(), Filtered.data() + (y - First) * (Stride + 1));
+			}
+
+			Block& Out = Blocks[b];
+			Out.Adler = Adler32(Filtered.data(), Filtered.size());
+			Out.Size = Filtered.size();
+			Out.Chunk = { 0, 0, 0, 0, 'I', 'D', 'A', 'T' };
+			if (b == 0)
+				Out.Chunk.insert(Out.Chunk.end(), { 0x78, 0x01 });
+			Deflate(Filtered.data(), Filtered.size(), b + 1 == BlockCount, Out.Chunk);
+		}, 1);
+
+		uint32_t Adler = Blocks[0].Adler;
+		for (size_t b = 1; b < BlockCount; b++)
+			Adler = CombineAdler32(Adler, Blocks[b].Adler, Blocks[b].Size);
+		AppendBigEndian32(Blocks.back().Chunk, Adler);
+		Parallel::For(BlockCount, [&](size_t b)
+		{
+			std::vector<uint8_t>& Chunk = Blocks[b].Chunk;
+			StoreBigEndian32(Chunk.data(), static_cast<uint32_t>(Chunk.size() - 8));
+			AppendBigEndian32(Chunk, Crc32(Chunk.data() + 4, Chunk.size() - 4));
+		}, 1);
+
+		std::vector<uint8_t> Out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		std::vector<uint8_t> Header;
+		AppendBigEndian32(Header, Width);
+		AppendBigEndian32(Header, Height);
+		// 8 bits per channel, RGB, deflate, adaptive filtering, no interlacing
+		Header.insert(Header.end(), { 8, 2, 0, 0, 0 });
+		AppendChunk(Out, "IHDR", Header);
+		for (const Block& b : Blocks)
+			Out.insert(Out.end(), b.Chunk.begin(), b.Chunk.end());
+		AppendChunk(Out, "IEND", {});
+		return Out;
+	}
+
+	std::vector<uint8_t> EncodeEXR(const std::vector<color4>& Pixels, int Width, int Height)
+	{
+		// Magic number, then version 2 with no flags: a single part of scanlines
+		std::vector<uint8_t> Out = { 0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0 };
+		auto Attribute = [&](const char* Name, const char* Type, const std::vector<uint8_t>& Value)
+		{
+			Out.insert(Out.end(), Name, Name + std::strlen(Name) + 1);
+			Out.insert(Out.end(), Type, Type + std::strlen(Type) + 1);
+			AppendLittleEndian(Out, Value.size(), 4);
+			Out.insert(Out.end(), Value.begin(), Value.end());
+		};
+		auto Values = [](std::initializer_list<uint32_t> Words)
+		{
+			std::vector<uint8_t> Bytes;
+			for (uint32_t Word : Words)
+				AppendLittleEndian(Bytes, Word, 4);
+			return Bytes;
+		};
+
+		// Channels in alphabetical order, each a half float sampled at every pixel
+		std::vector<uint8_t> Channels;
+		for (const char* Name : { "B", "G", "R" })
+		{
+			Channels.insert(Channels.end(), { uint8_t(Name[0]), 0 });
+			const std::vector<uint8_t> Channel = Values({ 1, 0, 1, 1 });
+			Channels.insert(Channels.end(), Channel.begin(), Channel.end());
+		}
+		Channels.push_back(0);
+		const std::vector<uint8_t> Window = Values({ 0, 0, uint32_t(Width - 1), uint32_t(Height - 1) });
+		Attribute("channels", "chlist", Channels);
+		Attribute("compression", "compression", { 0 });
+		Attribute("dataWindow", "box2i", Window);
+		Attribute("displayWindow", "box2i", Window);
+		Attribute("lineOrder", "lineOrder", { 0 });
+		Attribute("pixelAspectRatio", "float", Values({ std::bit_cast<uint32_t>(1.0f) }));
+		Attribute("screenWindowCenter", "v2f", Values({ 0, 0 }));
+		Attribute("screenWindowWidth", "float", Values({ std::bit_cast<uint32_t>(1.0f) }));
+		Out.push_back(0);
+
+		// An offset table with one entry per scanline, then the scanlines: their y and size, followed by the row
+		// of each channel
+		const size_t TableOffset = Out.size();
+		const size_t LineSize = 8 + size_t(Width) * 3 * sizeof(uint16_t);
+		const size_t DataOffset = TableOffset + size_t(Height) * sizeof(uint64_t);
+		Out.resize(DataOffset + LineSize * Height);
+		Parallel::For(Height, [&](size_t y)
+		{
+			StoreLittleEndian(&Out[TableOffset + y * sizeof(uint64_t)], DataOffset + y * LineSize, 8);
+			uint8_t* Line = &Out[DataOffset + y * LineSize];
+			StoreLittleEndian(Line, y, 4);
+			StoreLittleEndian(Line + 4, LineSize - 8, 4);
+			uint8_t* Halves = Line + 8;
+			const color4* Row = &Pixels[y * Width];
+			for (int x = 0; x < Width; x++)
+			{
+				StoreLittleEndian(Halves + 2 * x, FloatToHalf(Row[x].b), 2);
+				StoreLittleEndian(Halves + 2 * (Width + x), FloatToHalf(Row[x].g), 2);
+				StoreLittleEndian(Halves + 2 * (2 * Width + x), FloatToHalf(Row[x].r), 2);
+			}
+		}, 16);
+		return Out;
+	}
+
+	std::vector<uint8_t> Encode(ImageFormat Format, const std::vector<color4>& Pixels, int Width, int Height)
+	{
+		switch (Format)
+		{
+		case ImageFormat::PNG:
+			return EncodePNG(Pixels, Width, Height);
+		case ImageFormat::EXR:
+			return EncodeEXR(Pixels, Width, Height);
+		default:
+			return EncodePPM(Pixels, Width, Height);
+		}
+	}
+
+	bool FormatFromPath(const std::string& Path, ImageFormat& Format)
+	{
+		std::string Extension = std::filesystem::path(Path).extension().string();
+		std::transform(Extension.begin(), Extension.end(), Extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		if (Extension == ".ppm")
+			Format = ImageFormat::PPM;
+		else if (Extension == ".png")
+			Format = ImageFormat::PNG;
+		else if (Extension == ".exr")
+			Format = ImageFormat::EXR;
+		else
+			return false;
+		return true;
+	}
+
+	bool WriteFile(const std::string& Path, const std::vector<uint8_t>& Bytes)
+	{
+		std::ofstream File(Path, std::ios::binary);
+		File.write(reinterpret_cast<const char*>(Bytes.data()), Bytes.size());
+		// Closing flushes what's still buffered, which can fail too, e.g. on a full disk
+		File.close();
+		if (!File)
+		{
+			std::cerr << "Failed to write image: " << Path << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VecUtils.hpp"
+
+enum class ImageFormat
+{
+	// Binary 8 bit RGB
+	PPM,
+	// 8 bit RGB, deflated in parallel
+	PNG,
+	// Half float RGB scanlines, uncompressed
+	EXR,
+};
+
+// Image file encoders; Pixels are Width x Height, row by row from the top left
+// PPM and PNG hold the image as the viewer shows it, remapped by v / (v + 1) like Drawing::DrawPixel, while EXR keeps
+// the rendered values themselves
+namespace ImageOutput
+{
+	std::vector<uint8_t> EncodePPM(const std::vector<color4>& Pixels, int Width, int Height);
+
+	// Each block of RowsPerBlock rows is filtered and deflated on its own thread into its own IDAT chunk, without
+	// matches reaching back into the block before; smaller blocks spread better over threads and compress worse
+	std::vector<uint8_t> EncodePNG(const std::vector<color4>& Pixels, int Width, int Height, int RowsPerBlock = 32);
+
+	std::vector<uint8_t> EncodeEXR(const std::vector<color4>& Pixels, int Width, int Height);
+
+	std::vector<uint8_t> Encode(ImageFormat Format, const std::vector<color4>& Pixels, int Width, int Height);
+
+	// Format for a .ppm, .png or .exr path; false for any other extension
+	bool FormatFromPath(const std::string& Path, ImageFormat& Format);
+
+	// Returns false, after reporting it, if the file couldn't be written
+	bool WriteFile(const std::string& Path, const std::vector<uint8_t>& Bytes);
+}
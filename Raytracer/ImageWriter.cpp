@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <chrono>
+
+#include "ImageWriter.hpp"
+
+ImageWriter::ImageWriter(size_t Capacity) :
+	Capacity(std::max<size_t>(Capacity, 1)),
+	Worker([this] { Run(); })
+{
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard<std::mutex> Guard(Lock);
+		Stopping = true;
+	}
+	Changed.notify_all();
+	Worker.join();
+}
+
+void ImageWriter::Write(std::vector<color4> Pixels, int Width, int Height, std::string Path, ImageFormat Format)
+{
+	auto StartTime = std::chrono::high_resolution_clock::now();
+	std::unique_lock<std::mutex> Guard(Lock);
+	Changed.wait(Guard, [this] { return Queue.size() < Capacity; });
+	Totals.BlockedMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - StartTime).count();
+	Queue.push_back({ std::move(Pixels), Width, Height, std::move(Path), Format });
+	Guard.unlock();
+	Changed.notify_all();
+}
+
+bool ImageWriter::Flush()
+{
+	std::unique_lock<std::mutex> Guard(Lock);
+	Changed.wait(Guard, [this] { return Queue.empty() && !Busy; });
+	const bool Written = !WriteFailed;
+	WriteFailed = false;
+	return Written;
+}
+
+bool ImageWriter::Failed() const
+{
+	std::lock_guard<std::mutex> Guard(Lock);
+	return WriteFailed;
+}
+
+ImageWriterStats ImageWriter::Stats() const
+{
+	std::lock_guard<std::mutex> Guard(Lock);
+	return Totals;
+}
+
+void ImageWriter::Run()
+{
+	std::unique_lock<std::mutex> Guard(Lock);
+	while (true)
+	{
+		Changed.wait(Guard, [this] { return !Queue.empty() || Stopping; });
+		if (Queue.empty())
+			return;
+		Job Next = std::move(Queue.front());
+		Queue.pop_front();
+		Busy = true;
+		Guard.unlock();
+		// Taking the job off the queue makes room for another
+		Changed.notify_all();
+
+		auto StartTime = std::chrono::high_resolution_clock::now();
+		const std::vector<uint8_t> Bytes = ImageOutput::Encode(Next.Format, Next.Pixels, Next.Width, Next.Height);
+		auto EncodedTime = std::chrono::high_resolution_clock::now();
+		const bool Written = ImageOutput::WriteFile(Next.Path, Bytes);
+		auto StopTime = std::chrono::high_resolution_clock::now();
+
+		Guard.lock();
+		Busy = false;
+		WriteFailed = WriteFailed || !Written;
+		Totals.Images++;
+		Totals.Bytes += Written ? Bytes.size() : 0;
+		Totals.EncodeMs += std::chrono::duration<double, std::milli>(EncodedTime - StartTime).count();
+		Totals.FileMs += std::chrono::duration<double, std::milli>(StopTime - EncodedTime).count();
+		Changed.notify_all();
+	}
+}
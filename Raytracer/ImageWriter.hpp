@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ImageOutput.hpp"
+
+// What the writer thread has done so far
+struct ImageWriterStats
+{
+	uint64_t Images = 0;
+	// Bytes written to files
+	uint64_t Bytes = 0;
+	double EncodeMs = 0.0;
+	double FileMs = 0.0;
+	// Time Write spent waiting for room in the queue, i.e. what the writer held the caller up by
+	double BlockedMs = 0.0;
+};
+
+// Encodes and writes images on a thread of its own, so the caller can render the next frame meanwhile
+// At most Capacity images wait their turn; Write blocks while the queue is full, so a slow disk holds rendering
+// back instead of piling up frames in memory
+class ImageWriter
+{
+public:
+	explicit ImageWriter(size_t Capacity = 2);
+	// Writes whatever is still queued first
+	~ImageWriter();
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	// Queues Width x Height pixels, row by row from the top left, to be written to Path in Format
+	void Write(std::vector<color4> Pixels, int Width, int Height, std::string Path, ImageFormat Format);
+
+	// Waits until everything queued so far is written; false if any image failed since the last Flush
+	bool Flush();
+
+	// Whether an image has failed to be written since the last Flush, without waiting for the queue
+	bool Failed() const;
+
+	ImageWriterStats Stats() const;
+
+private:
+	struct Job
+	{
+		std::vector<color4> Pixels;
+		int Width;
+		int Height;
+		std::string Path;
+		ImageFormat Format;
+	};
+
+	void Run();
+
+	const size_t Capacity;
+	mutable std::mutex Lock;
+	// Signalled whenever a job is queued or finished, or the writer is told to stop
+	std::condition_variable Changed;
+	std::deque<Job> Queue{};
+	bool Busy = false;
+	bool Stopping = false;
+	bool WriteFailed = false;
+	ImageWriterStats Totals{};
+	std::thread Worker;
+};
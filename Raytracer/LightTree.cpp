@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "LightTree.hpp"
+
+void LightTree::Build(const std::vector<float>& X, const std::vector<float>& Y, const std::vector<float>& Z, const std::vector<float>& Intensity)
+{
+	Nodes.clear();
+	const uint32_t Count = static_cast<uint32_t>(X.size());
+	if (Count == 0)
+		return;
+
+	std::vector<uint32_t> Lights(Count);
+	std::iota(Lights.begin(), Lights.end(), 0);
+	auto Position = [&](uint32_t Light) { return vec3(X[Light], Y[Light], Z[Light]); };
+
+	// Splits Lights[First, Last) at the median of its widest axis; a tree with N leaves has 2N - 1 nodes
+	Nodes.reserve(Count * 2 - 1);
+	Nodes.emplace_back();
+	auto BuildNode = [&](auto& BuildNode, uint32_t NodeIndex, uint32_t First, uint32_t Last) -> void
+	{
+		AABB Bounds;
+		float Total = 0.0f;
+		for (uint32_t i = First; i < Last; i++)
+		{
+			Bounds.Grow(Position(Lights[i]));
+			Total += Intensity[Lights[i]];
+		}
+		Nodes[NodeIndex].Bounds = Bounds;
+		Nodes[NodeIndex].Intensity = Total;
+
+		if (Last - First == 1)
+		{
+			Nodes[NodeIndex].LeftOrLight = Lights[First];
+			Nodes[NodeIndex].Leaf = true;
+			return;
+		}
+
+		const vec3 Extent = Bounds.Max - Bounds.Min;
+		const int Axis = Extent.x > Extent.y ? (Extent.x > Extent.z ? 0 : 2) : (Extent.y > Extent.z ? 1 : 2);
+		const uint32_t Middle = First + (Last - First) / 2;
+		std::nth_element(Lights.begin() + First, Lights.begin() + Middle, Lights.begin() + Last,
+			[&](uint32_t a, uint32_t b) { return Position(a)[Axis] < Position(b)[Axis]; });
+
+		const uint32_t Left = static_cast<uint32_t>(Nodes.size());
+		Nodes[NodeIndex].LeftOrLight = Left;
+		Nodes.emplace_back();
+		Nodes.emplace_back();
+		BuildNode(BuildNode, Left, First, Middle);
+		BuildNode(BuildNode, Left + 1, Middle, Last);
+	};
+	BuildNode(BuildNode, 0, 0, Count);
+}
+
+float LightTree::Importance(const Node& Node, const vec3& Point, const vec3& Normal) const
+{
+	// Per component, since this runs twice per tree level for every sample
+	float CenterDistanceSquared = 0.0f;
+	float HalfExtentSquared = 0.0f;
+	float Height = 0.0f;
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		const float HalfExtent = (Node.Bounds.Max[Axis] - Node.Bounds.Min[Axis]) * 0.5f;
+		const float ToCenter = Node.Bounds.Min[Axis] + HalfExtent - Point[Axis];
+		CenterDistanceSquared += ToCenter * ToCenter;
+		HalfExtentSquared += HalfExtent * HalfExtent;
+		Height += Normal[Axis] * ToCenter + std::abs(Normal[Axis]) * HalfExtent;
+	}
+
+	// Height is the furthest any corner of the bounds gets above the surface's tangent plane
+	if (Height <= 0.0f)
+		return 0.0f;
+	return Node.Intensity / std::max(std::max(CenterDistanceSquared, HalfExtentSquared), 1e-6f);
+}
+
+uint32_t LightTree::Sample(const vec3& Point, const vec3& Normal, float u, float& Pdf) const
+{
+	Pdf = 1.0f;
+	if (Nodes.empty())
+		return NO_LIGHT;
+
+	uint32_t Current = 0;
+	while (!Nodes[Current].Leaf)
+	{
+		const uint32_t Left = Nodes[Current].LeftOrLight;
+		const float LeftImportance = Importance(Nodes[Left], Point, Normal);
+		const float RightImportance = Importance(Nodes[Left + 1], Point, Normal);
+		const float Total = LeftImportance + RightImportance;
+		if (Total <= 0.0f)
+			return NO_LIGHT;
+
+		// Reuse u for the next level by rescaling whichever side of the split it fell on
+		const float LeftProbability = LeftImportance / Total;
+		if (u < LeftProbability)
+		{
+			Current = Left;
+			Pdf *= LeftProbability;
+			u = std::min(u / LeftProbability, 0.99999994f);
+		}
+		else
+		{
+			Current = Left + 1;
+			Pdf *= 1.0f - LeftProbability;
+			u = std::min((u - LeftProbability) / (1.0f - LeftProbability), 0.99999994f);
+		}
+	}
+	return Nodes[Current].LeftOrLight;
+}
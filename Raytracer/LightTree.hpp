@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "BVH.hpp"
+#include "VecUtils.hpp"
+
+// Binary tree over point lights, for picking a few of thousands of lights in proportion to how much they
+// are likely to contribute at a shading point; every node knows its bounds and the total intensity below it
+class LightTree
+{
+public:
+	// Builds over point lights given one array per component, as in LightSet
+	void Build(const std::vector<float>& X, const std::vector<float>& Y, const std::vector<float>& Z, const std::vector<float>& Intensity);
+
+	// Walks down from the root, picking each child with probability proportional to its estimated contribution at Point
+	// u is uniform in [0, 1); returns the light's index and its probability in Pdf, or NO_LIGHT if nothing can reach Point
+	uint32_t Sample(const vec3& Point, const vec3& Normal, float u, float& Pdf) const;
+
+	bool Empty() const { return Nodes.empty(); }
+	size_t MemoryUsage() const { return Nodes.size() * sizeof(Node); }
+
+	static constexpr uint32_t NO_LIGHT = std::numeric_limits<uint32_t>::max();
+
+private:
+	struct Node
+	{
+		AABB Bounds;
+		float Intensity = 0.0f;
+		// Light index for leaves, left child for interior nodes (the right child follows it)
+		uint32_t LeftOrLight = 0;
+		bool Leaf = false;
+	};
+
+	// Intensity over squared distance, clamped so points inside the bounds don't blow up,
+	// and zero when the whole node is behind the surface
+	float Importance(const Node& Node, const vec3& Point, const vec3& Normal) const;
+
+	std::vector<Node> Nodes{};
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+	inline unsigned ThreadCount()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// How many ranges ForRanges should split Count items into so each thread gets at least MinPerRange of them
+	inline size_t RangeCount(size_t Count, size_t MinPerRange)
+	{
+		return std::clamp<size_t>(Count / std::max<size_t>(MinPerRange, 1), 1, ThreadCount());
+	}
+
+	// Splits [0, Count) into Ranges contiguous pieces and calls Fn(Begin, End, RangeIndex) for each on its own thread
+	// The calling thread handles the first range itself, and everything has finished when this returns
+	template <typename Fn>
+	void ForRanges(size_t Count, size_t Ranges, Fn&& F)
+	{
+		Ranges = std::max<size_t>(Ranges, 1);
+		auto RangeBegin = [&](size_t Range) { return Count * Range / Ranges; };
+
+		std::vector<std::thread> Threads;
+		Threads.reserve(Ranges - 1);
+		for (size_t Range = 1; Range < Ranges; Range++)
+			Threads.emplace_back([&, Range] { F(RangeBegin(Range), RangeBegin(Range + 1), Range); });
+
+		F(RangeBegin(0), RangeBegin(1), size_t(0));
+		for (std::thread& Thread : Threads)
+			Thread.join();
+	}
+
+	// Calls Fn(i) for every i in [0, Count), spread over all threads
+	template <typename Fn>
+	void For(size_t Count, Fn&& F, size_t MinPerRange = 1024)
+	{
+		ForRanges(Count, RangeCount(Count, MinPerRange), [&](size_t Begin, size_t End, size_t)
+		{
+			for (size_t i = Begin; i < End; i++)
+				F(i);
+		});
+	}
+
+	// Stable least significant digit radix sort of Keys, carrying Values along; each pass sorts 8 bits
+	inline void RadixSort(std::vector<uint32_t>& Keys, std::vector<uint32_t>& Values, int KeyBits)
+	{
+		constexpr int DIGIT_BITS = 8;
+		constexpr int DIGIT_COUNT = 1 << DIGIT_BITS;
+
+		const size_t Count = Keys.size();
+		const size_t Ranges = RangeCount(Count, 1 << 14);
+		std::vector<uint32_t> KeysOut(Count);
+		std::vector<uint32_t> ValuesOut(Count);
+		std::vector<size_t> Offsets(Ranges * DIGIT_COUNT);
+
+		for (int Shift = 0; Shift < KeyBits; Shift += DIGIT_BITS)
+		{
+			// Per range histograms
+			std::fill(Offsets.begin(), Offsets.end(), 0);
+			ForRanges(Count, Ranges, [&](size_t Begin, size_t End, size_t Range)
+			{
+				size_t* Histogram = &Offsets[Range * DIGIT_COUNT];
+				for (size_t i = Begin; i < End; i++)
+					Histogram[(Keys[i] >> Shift) & (DIGIT_COUNT - 1)]++;
+			});
+
+			// Turn the histograms into write offsets; digit-major so each range lands after the ranges before it
+			size_t Total = 0;
+			for (int Digit = 0; Digit < DIGIT_COUNT; Digit++)
+			{
+				for (size_t Range = 0; Range < Ranges; Range++)
+				{
+					size_t Bucket = Offsets[Range * DIGIT_COUNT + Digit];
+					Offsets[Range * DIGIT_COUNT + Digit] = Total;
+					Total += Bucket;
+				}
+			}
+
+			ForRanges(Count, Ranges, [&](size_t Begin, size_t End, size_t Range)
+			{
+				size_t* Offset = &Offsets[Range * DIGIT_COUNT];
+				for (size_t i = Begin; i < End; i++)
+				{
+					size_t Destination = Offset[(Keys[i] >> Shift) & (DIGIT_COUNT - 1)]++;
+					KeysOut[Destination] = Keys[i];
+					ValuesOut[Destination] = Values[i];
+				}
+			});
+			Keys.swap(KeysOut);
+			Values.swap(ValuesOut);
+		}
+	}
+}
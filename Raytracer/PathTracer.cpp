@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "Drawing.hpp"
+#include "Parallel.hpp"
+#include "PathTracer.hpp"
+#include "Sampling.hpp"
+
+namespace {
+	// Direction around the unit normal with a density proportional to its cosine with the normal
+	vec3 CosineSample(vec3 Normal, float u, float v)
+	{
+		// Orthonormal basis around the normal (Duff et al., "Building an Orthonormal Basis, Revisited")
+		const float Sign = std::copysign(1.0f, Normal.z);
+		const float a = -1.0f / (Sign + Normal.z);
+		const float b = Normal.x * Normal.y * a;
+		const vec3 Tangent = vec3(1.0f + Sign * Normal.x * Normal.x * a, Sign * b, -Sign * Normal.x);
+		const vec3 Bitangent = vec3(b, Sign + Normal.y * Normal.y * a, -Normal.y);
+
+		const float Radius = std::sqrt(u);
+		const float Angle = 2.0f * std::numbers::pi_v<float> * v;
+		const float z = std::sqrt(std::max(1.0f - u, 0.0f));
+		return Tangent * (Radius * std::cos(Angle)) + Bitangent * (Radius * std::sin(Angle)) + Normal * z;
+	}
+
+	color4 Modulate(const color4& a, const color4& b)
+	{
+		return color4(a.r * b.r, a.g * b.g, a.b * b.b, a.a * b.a);
+	}
+
+	// Counts for one range of rows
+	struct PassCounts
+	{
+		uint64_t Bounces = 0;
+		uint64_t Lights = 0;
+		uint32_t MaxPixelLights = 0;
+	};
+
+	// Radiance along the path, with the first hit filled in as TraceRay does
+	template <Accelerator T>
+	RayPayload TracePath(const Scene& Scene, const T& Objects, Ray R, Sampling::SobolSampler& Sampler, PassCounts& Counts)
+	{
+		RayPayload Result(std::numeric_limits<float>::max(), color4(0, 0, 0, 0));
+		const PathTracingSettings& Settings = Scene.PathTracing;
+		color4 Radiance = color4(0, 0, 0, 0);
+		color4 Throughput = Colors::White;
+		bool MirrorPath = true;
+
+		for (int Bounce = 0; Bounce <= Settings.MaxBounces; Bounce++)
+		{
+			std::optional<RayHit> Hit = Raytracer::ClosestHit(Scene, Objects, R, 1e-6f, std::numeric_limits<float>::max());
+			if (!Hit)
+			{
+				// Camera and mirror rays see the background, as with TraceRay; anything else sees the ambient sky
+				const color4 Sky = MirrorPath ? Scene.BackgroundColor : Colors::White * Scene.LightsByType.Ambient;
+				Radiance = Radiance + Modulate(Throughput, Sky);
+				break;
+			}
+			Counts.Bounces += Bounce > 0;
+			if (Bounce == 0)
+			{
+				Result.t = Hit->t;
+				Result.Surface = Hit->Surface;
+				Result.Normal = Hit->Normal;
+				Result.Albedo = Hit->Mat->Color;
+			}
+
+			// Every bounce takes one set of Sobol dimensions, whichever way the path goes, so the bounce
+			// direction always gets the best stratified pair
+			Sampler.Dimension = Sampling::SOBOL_DIMENSIONS * (Bounce + 1);
+			const float u = Sampler.Next();
+			const float v = Sampler.Next();
+			const float Choice = Sampler.Next();
+			const float Roulette = Sampler.Next();
+
+			const Material& Mat = *Hit->Mat;
+			const vec3 Point = R.Origin + Hit->t * R.Direction;
+			const vec3 Offset = Point + Hit->Normal * 1e-4f;
+			if (Mat.Reflective > 0.0f && Choice < Mat.Reflective)
+			{
+				// Picked with the probability of its weight in TraceRay, which cancels the weight out
+				R = Ray(Offset, R.Direction - Hit->Normal * (2.0f * VecUtils::dot(R.Direction, Hit->Normal)));
+				continue;
+			}
+
+			uint32_t LightCount = 0;
+			const float Direct = Raytracer::DirectLighting(Scene, Objects, Point, Hit->Normal, -R.Direction, Mat.Specular, LightCount);
+			Result.LightCount += LightCount;
+			Throughput = Modulate(Throughput, Mat.Color);
+			Radiance = Radiance + Throughput * Direct;
+			MirrorPath = false;
+
+			// Russian roulette; surviving paths are scaled up by as much as the ones ended would have added
+			if (Bounce + 1 >= Settings.MinBounces)
+			{
+				const float Survival = std::min(std::max({ Throughput.r, Throughput.g, Throughput.b }), 0.95f);
+				if (Roulette >= Survival)
+					break;
+				Throughput = Throughput * (1.0f / Survival);
+			}
+
+			R = Ray(Offset, CosineSample(Hit->Normal, u, v));
+		}
+		Result.Color = Radiance;
+		return Result;
+	}
+
+	template <Accelerator T>
+	FrameStats TracePass(const Scene& Scene, const T& Objects, std::vector<color4>& Sum, uint32_t Pass, Framebuffer& Frame)
+	{
+		const int Width = Frame.Width;
+		const int Height = Frame.Height;
+		const float Weight = 1.0f / (Pass + 1);
+		const size_t Ranges = Parallel::RangeCount(Height, 8);
+		std::vector<PassCounts> RangeCounts(Ranges);
+
+		Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t Range)
+		{
+			PassCounts& Counts = RangeCounts[Range];
+			for (int y = static_cast<int>(Begin); y < static_cast<int>(End); y++)
+			{
+				for (int x = 0; x < Width; x++)
+				{
+					const size_t i = size_t(y) * Width + x;
+					// Pass n is the n-th point of the pixel's own scrambled Sobol sequence
+					Sampling::SobolSampler Sampler(Sampling::Hash(Scene.PathTracing.Seed, static_cast<uint32_t>(i)), Pass);
+					const float OffsetX = Sampler.Next() - 0.5f;
+					const float OffsetY = Sampler.Next() - 0.5f;
+					const Ray R = Ray(Scene.Camera.Position, Scene.Camera.PixelDirection(x + OffsetX, y + OffsetY));
+
+					const RayPayload Result = TracePath(Scene, Objects, R, Sampler, Counts);
+					Sum[i] = Sum[i] + Result.Color;
+					Frame.Pixels[i] = Sum[i] * Weight;
+					Frame.Surfaces[i] = Result.Surface;
+					Frame.Depth[i] = Result.t;
+					Frame.Normals[i] = Result.Normal;
+					Frame.Albedo[i] = Result.Albedo;
+					Counts.Lights += Result.LightCount;
+					Counts.MaxPixelLights = std::max(Counts.MaxPixelLights, Result.LightCount);
+				}
+			}
+		});
+
+		FrameStats Stats;
+		uint64_t Bounces = 0;
+		uint64_t Lights = 0;
+		for (const PassCounts& Counts : RangeCounts)
+		{
+			Bounces += Counts.Bounces;
+			Lights += Counts.Lights;
+			Stats.MaxPixelLights = std::max(Stats.MaxPixelLights, Counts.MaxPixelLights);
+		}
+		const double PixelCount = static_cast<double>(Frame.Pixels.size());
+		Stats.SamplesPerPixel = 1.0;
+		Stats.LightsPerPixel = Lights / PixelCount;
+		Stats.BouncesPerSample = Bounces / PixelCount;
+		return Stats;
+	}
+}
+
+FrameStats PathTracer::RenderPass(Scene& Scene, Framebuffer& Frame)
+{
+	Frame.Resize(Drawing::ResX, Drawing::ResY);
+	Scene.Camera.Update(Frame.Width, Frame.Height);
+	if (Sum.size() != Frame.Pixels.size())
+		Reset();
+	if (Sum.empty())
+		Sum.assign(Frame.Pixels.size(), color4(0, 0, 0, 0));
+
+	// The shadow cache would blur the shadows the passes converge to
+	const bool CacheShadows = Scene.CacheShadows;
+	Scene.CacheShadows = false;
+	FrameStats Stats = std::visit([&](const auto& Objects) { return TracePass(Scene, Objects, Sum, Passes, Frame); }, Scene.Objects);
+	Scene.CacheShadows = CacheShadows;
+
+	Passes++;
+	return Stats;
+}
+
+void PathTracer::Reset()
+{
+	Sum.clear();
+	Passes = 0;
+}
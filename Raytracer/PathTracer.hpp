@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Raytracer.hpp"
+#include "Rendering.hpp"
+
+// Progressive path tracer; every pass adds one jittered path per pixel to a running average
+// Diffuse bounces are cosine weighted, and every diffuse hit also gathers the scene's lights directly
+// (next-event estimation), shaded the way TraceRay shades them. Reflective surfaces pick a mirror bounce
+// with a probability of their reflectivity. Ambient light becomes a uniform sky that only paths leaving
+// through a diffuse bounce see, so it is occluded where TraceRay adds it everywhere
+class PathTracer
+{
+public:
+	// Renders one pass with Scene.PathTracing into Frame, which holds the average of every pass since the last Reset
+	// Surfaces, depth, normals and albedo are what this pass's first hits saw
+	// Starts over on its own when the frame size changes; call Reset whenever the scene or camera changes
+	// Expects Scene.UpdateAcceleration to have been called
+	FrameStats RenderPass(Scene& Scene, Framebuffer& Frame);
+
+	void Reset();
+
+	uint32_t PassCount() const { return Passes; }
+
+private:
+	std::vector<color4> Sum{};
+	uint32_t Passes = 0;
+};
@@ -1,9 +1,15 @@
 #pragma once
+#include <bit>
+#include <chrono>
 #include <optional>
 #include <iostream>
+#include <type_traits>
+#include <variant>
 
 #include "VecUtils.hpp"
 #include "Raytracer.hpp"
+#include "Sampling.hpp"
+#include "ShadingMath.hpp"
 
 namespace {
 	// Reflects ray direction over the normal and returns a new direction, normalized
@@ -13,114 +19,653 @@ namespace {
 		return VecUtils::normalize(2 * Normal * VecUtils::dot(RayDirection, Normal) - RayDirection);
 	}
 
-	// Uses the quadratic equation to determine where a ray collides with a sphere
-	static std::pair<float, float> RayIntersectSphere(Ray& Ray, Sphere& s)
+	// Returns the distance along the ray to the plane, or max float if the ray runs parallel to it
+	float RayIntersectPlane(const Ray& Ray, const Plane& p)
 	{
-		vec3 OriginToSphere = Ray.Origin - s.Origin;
-		float a = VecUtils::length2(Ray.Direction);
-		float b = 2 * VecUtils::dot(OriginToSphere, Ray.Direction);
-		float c = VecUtils::length2(OriginToSphere) - (s.Radius * s.Radius);
+		const float NormalDotDirection = VecUtils::dot(p.Normal, Ray.Direction);
+		if (std::abs(NormalDotDirection) < 1e-8f)
+			return std::numeric_limits<float>::max();
+		return VecUtils::dot(p.Point - Ray.Origin, p.Normal) / NormalDotDirection;
+	}
+
+	// Moller-Trumbore ray/triangle test; returns the distance along the ray, or max float on a miss
+	// Triangles are double-sided
+	float RayIntersectTriangle(const Ray& Ray, const vec3& v0, const vec3& v1, const vec3& v2)
+	{
+		constexpr float Epsilon = 1e-8f;
+		const vec3 Edge1 = v1 - v0;
+		const vec3 Edge2 = v2 - v0;
+		const vec3 P = VecUtils::cross(Ray.Direction, Edge2);
+		const float Determinant = VecUtils::dot(Edge1, P);
+		if (std::abs(Determinant) < Epsilon)
+			return std::numeric_limits<float>::max();
+
+		const float InvDeterminant = 1.0f / Determinant;
+		const vec3 T = Ray.Origin - v0;
+		const float u = VecUtils::dot(T, P) * InvDeterminant;
+		if (u < 0.0f || u > 1.0f)
+			return std::numeric_limits<float>::max();
+
+		const vec3 Q = VecUtils::cross(T, Edge1);
+		const float v = VecUtils::dot(Ray.Direction, Q) * InvDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+			return std::numeric_limits<float>::max();
+
+		return VecUtils::dot(Edge2, Q) * InvDeterminant;
+	}
+
+	vec3 InverseDirection(const Ray& Ray)
+	{
+		return vec3(1.0f / Ray.Direction.x, 1.0f / Ray.Direction.y, 1.0f / Ray.Direction.z);
+	}
 
-		float Discriminant = b * b - 4 * a * c;
-		if (Discriminant < 0)
-			return std::pair<float, float>(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	constexpr size_t NO_TRIANGLE = std::numeric_limits<size_t>::max();
 
-		float t1 = (-b - std::sqrt(Discriminant)) / (2 * a);
-		float t2 = (-b + std::sqrt(Discriminant)) / (2 * a);
-		return std::pair<float, float>(t1, t2);
+	// Finds the closest triangle of the mesh before TMax through its BVH, narrowing TMax down to it
+	// With AnyHit set it stops at the first hit instead
+	// Returns the first index of the hit triangle, or NO_TRIANGLE on a miss
+	size_t IntersectMeshTriangles(const TriangleMesh& m, const Ray& Ray, float TMin, float& TMax, bool AnyHit)
+	{
+		size_t HitTriangle = NO_TRIANGLE;
+		m.Triangles.Traverse(Ray.Origin, InverseDirection(Ray), TMin, TMax, [&](uint32_t Triangle, float& ClosestT)
+		{
+			const size_t i = Triangle * size_t(3);
+			float t = RayIntersectTriangle(Ray, m.Vertices[m.Indices[i]], m.Vertices[m.Indices[i + 1]], m.Vertices[m.Indices[i + 2]]);
+			if (t <= TMin || t >= ClosestT)
+				return false;
+			ClosestT = t;
+			HitTriangle = i;
+			return AnyHit;
+		});
+		return HitTriangle;
+	}
+
+	// Moves a world space ray into the instance's object space
+	// The direction is left unnormalized so distances along the ray stay the same in both spaces
+	Ray ToObjectSpace(const Ray& WorldRay, const MeshInstance& Instance)
+	{
+		Ray ObjectRay;
+		ObjectRay.Origin = Instance.WorldToObject.TransformPoint(WorldRay.Origin);
+		ObjectRay.Direction = Instance.WorldToObject.TransformVector(WorldRay.Direction);
+		return ObjectRay;
 	}
 
-	static std::pair<float, std::optional<Sphere>> ClosestIntersection(Scene& Scene, Ray& Ray, float TMin = 1e-6, float TMax = std::numeric_limits<float>::max())
+	// The surface a ray hit; at most one of HitSphere, HitPlane and HitMesh is set
+	struct SurfaceRef
 	{
-		float ClosestT = std::numeric_limits<float>::max();
-		std::optional<Sphere> ClosestSphere;
+		const Sphere* HitSphere = nullptr;
+		const Plane* HitPlane = nullptr;
+		const TriangleMesh* HitMesh = nullptr;
+		// Set along with HitMesh when the mesh was hit through an instance
+		const MeshInstance* HitInstance = nullptr;
+		size_t Triangle = 0;
+	};
 
-		for (Sphere& s : Scene.Spheres)
+	// Finds the closest surface before TMax and narrows TMax down to it
+	// With AnyHit set it stops at the first hit instead; returns whether anything was hit
+	template <Accelerator T>
+	bool FindIntersection(const Scene& Scene, const T& Objects, const Ray& Ray, float TMin, float& TMax, bool AnyHit, SurfaceRef& Closest)
+	{
+		bool Found = false;
+		for (const Plane& p : Scene.Planes)
 		{
-			auto [t1, t2] = RayIntersectSphere(Ray, s);
-			if (t1 > TMin && t1 < TMax && t1 < ClosestT)
+			float t = RayIntersectPlane(Ray, p);
+			if (t > TMin && t < TMax)
 			{
-				ClosestT = t1;
-				ClosestSphere = s;
+				TMax = t;
+				Closest = SurfaceRef{ .HitPlane = &p };
+				Found = true;
+				if (AnyHit)
+					return true;
 			}
-			if (t2 > TMin && t2 < TMax && t2 < ClosestT)
+		}
+
+		auto IntersectObject = [&](uint32_t ObjectIndex, float& ClosestT)
+		{
+			const SceneObject& Object = Scene.ObjectList[ObjectIndex];
+			switch (Object.Type)
+			{
+			case SceneObject::ObjectType::Sphere:
 			{
-				ClosestT = t2;
-				ClosestSphere = s;
+				const Sphere& s = Scene.Spheres[Object.Index];
+				const float t = s.Intersect(Ray, TMin);
+				if (t >= ClosestT)
+					return false;
+				ClosestT = t;
+				Closest = SurfaceRef{ .HitSphere = &s };
+				break;
 			}
+			case SceneObject::ObjectType::Mesh:
+			{
+				const TriangleMesh& m = Scene.Meshes[Object.Index];
+				size_t Triangle = IntersectMeshTriangles(m, Ray, TMin, ClosestT, AnyHit);
+				if (Triangle == NO_TRIANGLE)
+					return false;
+				Closest = SurfaceRef{ .HitMesh = &m, .Triangle = Triangle };
+				break;
+			}
+			case SceneObject::ObjectType::Instance:
+			{
+				const MeshInstance& Instance = Scene.Instances[Object.Index];
+				const TriangleMesh& m = Scene.SharedMeshes[Instance.MeshIndex];
+				size_t Triangle = IntersectMeshTriangles(m, ToObjectSpace(Ray, Instance), TMin, ClosestT, AnyHit);
+				if (Triangle == NO_TRIANGLE)
+					return false;
+				Closest = SurfaceRef{ .HitMesh = &m, .HitInstance = &Instance, .Triangle = Triangle };
+				break;
+			}
+			}
+			return true;
+		};
+
+		const vec3 InvDirection = InverseDirection(Ray);
+		if (AnyHit)
+			return Acceleration::AnyHit(Objects, Ray.Origin, InvDirection, TMin, TMax, IntersectObject);
+		return Acceleration::ClosestHit(Objects, Ray.Origin, InvDirection, TMin, TMax, IntersectObject) || Found;
+	}
+
+	template <Accelerator T>
+	std::optional<RayHit> ClosestIntersection(const Scene& Scene, const T& Objects, const Ray& Ray, float TMin = 1e-6, float TMax = std::numeric_limits<float>::max())
+	{
+		SurfaceRef Closest;
+		if (!FindIntersection(Scene, Objects, Ray, TMin, TMax, false, Closest))
+			return std::nullopt;
+
+		// Normals are only worked out for the surface that was actually hit
+		RayHit Hit;
+		Hit.t = TMax;
+		if (Closest.HitInstance)
+			Hit.Surface = Closest.HitInstance;
+		else if (Closest.HitSphere)
+			Hit.Surface = Closest.HitSphere;
+		else if (Closest.HitPlane)
+			Hit.Surface = Closest.HitPlane;
+		else
+			Hit.Surface = Closest.HitMesh;
+
+		if (Closest.HitSphere)
+		{
+			Hit.Normal = Closest.HitSphere->Normal(Ray.Origin + TMax * Ray.Direction);
+			Hit.Mat = &Closest.HitSphere->Mat;
 		}
+		else if (Closest.HitPlane)
+		{
+			Hit.Normal = VecUtils::dot(Closest.HitPlane->Normal, Ray.Direction) > 0 ? -Closest.HitPlane->Normal : Closest.HitPlane->Normal;
+			Hit.Mat = &Closest.HitPlane->Mat;
+		}
+		else
+		{
+			const TriangleMesh& m = *Closest.HitMesh;
+			const vec3& v0 = m.Vertices[m.Indices[Closest.Triangle]];
+			const vec3& v1 = m.Vertices[m.Indices[Closest.Triangle + 1]];
+			const vec3& v2 = m.Vertices[m.Indices[Closest.Triangle + 2]];
+			Hit.Normal = VecUtils::cross(v1 - v0, v2 - v0);
+			Hit.Mat = &m.Mat;
 
-		return std::pair<float, std::optional<Sphere>>(ClosestT, ClosestSphere);
+			// Instanced normals go back to world space through the inverse transpose
+			if (Closest.HitInstance)
+			{
+				Hit.Normal = Closest.HitInstance->WorldToObject.TransformTransposed(Hit.Normal);
+				if (Closest.HitInstance->MaterialOverride)
+					Hit.Mat = &Closest.HitInstance->MaterialOverride.value();
+			}
+
+			Hit.Normal = VecUtils::normalize(Hit.Normal);
+			if (VecUtils::dot(Hit.Normal, Ray.Direction) > 0)
+				Hit.Normal = -Hit.Normal;
+		}
+		return Hit;
 	}
 
-	// Computes the intensity of light at a given point
-	// Expects the normal and view direction as unit vectors
-	float ComputeLighting(Scene& Scene, vec3 Point, vec3 Normal, vec3 ViewDirection, std::optional<float> Specular)
+	// Returns true as soon as anything blocks the ray between TMin and TMax; used for shadow rays
+	template <Accelerator T>
+	bool AnyIntersection(const Scene& Scene, const T& Objects, const Ray& Ray, float TMin, float TMax)
 	{
-		float Intensity = 0.0f;
-		for (const Light& l : Scene.Lights)
+		SurfaceRef Blocker;
+		return FindIntersection(Scene, Objects, Ray, TMin, TMax, true, Blocker);
+	}
+
+	// Lights are shaded in batches of this many, so the per-light arrays fit on the stack
+	constexpr size_t LIGHT_BATCH_SIZE = 32;
+
+	// Up to LIGHT_BATCH_SIZE lights of one type, as seen from one shading point
+	struct LightBatch
+	{
+		size_t Count = 0;
+		// Already scaled by falloff and sampling weights
+		float Intensity[LIGHT_BATCH_SIZE];
+		// Point light index, or the number of point lights plus the directional light index, as ShadowCache expects
+		uint32_t LightId[LIGHT_BATCH_SIZE];
+		// Unit directions towards the lights
+		float DirectionX[LIGHT_BATCH_SIZE];
+		float DirectionY[LIGHT_BATCH_SIZE];
+		float DirectionZ[LIGHT_BATCH_SIZE];
+		// How far shadow rays need to look
+		float Distance[LIGHT_BATCH_SIZE];
+		float NormalDotDirection[LIGHT_BATCH_SIZE];
+	};
+
+	// Adds the light a batch contributes to Intensity, and the cache lookups it made to ShadowCounts
+	// Every light's unshadowed contribution is worked out first; the shadow rays are then traced back to back,
+	// and only for the lights that would add anything and that Shadows, if given, doesn't already know about
+	template <Accelerator T>
+	void ShadeLightBatch(const Scene& Scene, const T& Objects, const LightBatch& Batch, vec3 ShadowOrigin, vec3 Normal, vec3 ViewDirection, std::optional<float> Specular,
+		const ShadowCache* Shadows, const ShadowCache::PointKey& Key, ShadowCacheStats& ShadowCounts, float& Intensity)
+	{
+		float Contribution[LIGHT_BATCH_SIZE];
+
+		// Diffuse
+		for (size_t i = 0; i < Batch.Count; i++)
+			Contribution[i] = Batch.Intensity[i] * std::max(Batch.NormalDotDirection[i], 0.0f);
+
+		// Specular; the light reflected about the normal, dotted with the view direction, without building the reflection itself
+		if (Specular.has_value())
 		{
-			// Ambient light is a simple add
-			if (l.Type == LightType::Ambient)
+			const float NormalDotView = VecUtils::dot(Normal, ViewDirection);
+			const float Exponent = Specular.value();
+			float ReflectedDotView[LIGHT_BATCH_SIZE];
+			for (size_t i = 0; i < Batch.Count; i++)
 			{
-				Intensity += l.Intensity;
+				const float DirectionDotView = Batch.DirectionX[i] * ViewDirection.x + Batch.DirectionY[i] * ViewDirection.y + Batch.DirectionZ[i] * ViewDirection.z;
+				ReflectedDotView[i] = 2.0f * Batch.NormalDotDirection[i] * NormalDotView - DirectionDotView;
+			}
+			if (Scene.FastSpecular)
+			{
+				for (size_t i = 0; i < Batch.Count; i++)
+					Contribution[i] += Batch.Intensity[i] * 50.0f * ShadingMath::Pow(ReflectedDotView[i], Exponent);
 			}
 			else
 			{
-				// Direction depends on what kind of light; Point lights must be computed, Directional is already known
-				vec3 Direction = l.Type == LightType::Point ? (l.Position - Point) : l.Direction;
-				Direction = VecUtils::normalize(Direction);
-
-				// Shadow check; if the light source is obstructed, it does not contribute light
-				float TMax = l.Type == LightType::Point ? 1 : std::numeric_limits<float>::max();
-				Ray ShadowRay = Ray(Point + Normal * 1e-4f, Direction);
-				auto [ShadowT, ShadowSphere] = ClosestIntersection(Scene, ShadowRay, 1e-6, TMax);
-				if (ShadowSphere)
-					continue;
-
-				// Diffuse
-				float NormalDotDirection = VecUtils::dot(Normal, Direction);
-				if (NormalDotDirection > 0)
-					Intensity += l.Intensity * NormalDotDirection;
-
-				// Specular
-				if (Specular.has_value())
+				for (size_t i = 0; i < Batch.Count; i++)
+				{
+					if (ReflectedDotView[i] > 0)
+						Contribution[i] += Batch.Intensity[i] * 50.0f * std::pow(ReflectedDotView[i], Exponent);
+				}
+			}
+		}
+
+		// Shadow check; if the light source is obstructed, it does not contribute light
+		for (size_t i = 0; i < Batch.Count; i++)
+		{
+			if (Contribution[i] <= 0.0f)
+				continue;
+			bool Visible = false;
+			const bool Cached = Shadows && Shadows->Lookup(Key, Batch.LightId[i], Visible);
+			if (Shadows)
+			{
+				ShadowCounts.Lookups++;
+				ShadowCounts.Hits += Cached;
+			}
+			if (!Cached || Shadows->Verify)
+			{
+				Ray ShadowRay = Ray(ShadowOrigin, vec3(Batch.DirectionX[i], Batch.DirectionY[i], Batch.DirectionZ[i]));
+				const bool Traced = !AnyIntersection(Scene, Objects, ShadowRay, 1e-6, Batch.Distance[i]);
+				if (Cached)
+				{
+					ShadowCounts.Verified++;
+					ShadowCounts.Mismatches += Traced != Visible;
+				}
+				else
 				{
-					const vec3 Reflected = Reflect(Direction, Normal);
-					const float ReflectedDotView = VecUtils::dot(Reflected, ViewDirection);
-					if (ReflectedDotView > 0)
-					{
-						Intensity += l.Intensity * 50.0f * std::pow(ReflectedDotView, Specular.value());
-					}
+					Visible = Traced;
+					if (Shadows)
+						Shadows->Store(Key, Batch.LightId[i], Visible);
 				}
 			}
+			if (Visible)
+				Intensity += Contribution[i];
+		}
+	}
+
+	// Fills in the batch's Slot for the given point light, with its intensity multiplied by Scale
+	void SetPointLight(LightBatch& Batch, size_t Slot, const LightSet& Lights, size_t Light, vec3 Point, vec3 Normal, float Scale)
+	{
+		const float x = Lights.PointX[Light] - Point.x;
+		const float y = Lights.PointY[Light] - Point.y;
+		const float z = Lights.PointZ[Light] - Point.z;
+		const float DistanceSquared = x * x + y * y + z * z;
+		const float Distance = std::sqrt(DistanceSquared);
+		const float InvDistance = 1.0f / Distance;
+
+		// Inverse square falloff, faded by (1 - (d / r)^4)^2 so it reaches zero exactly at the influence radius
+		float Intensity = Lights.PointIntensity[Light] * Scale;
+		const float Radius = Lights.PointRadius[Light];
+		if (Radius != std::numeric_limits<float>::infinity())
+		{
+			const float Ratio = DistanceSquared / (Radius * Radius);
+			const float Window = std::max(1.0f - Ratio * Ratio, 0.0f);
+			Intensity *= Window * Window / (1.0f + DistanceSquared);
+		}
+		Batch.Intensity[Slot] = Intensity;
+		Batch.LightId[Slot] = static_cast<uint32_t>(Light);
+		Batch.DirectionX[Slot] = x * InvDistance;
+		Batch.DirectionY[Slot] = y * InvDistance;
+		Batch.DirectionZ[Slot] = z * InvDistance;
+		Batch.Distance[Slot] = Distance;
+		Batch.NormalDotDirection[Slot] = (Normal.x * x + Normal.y * y + Normal.z * z) * InvDistance;
+	}
+
+	// Value in [0, 1) hashed from a point's coordinates, so sampling at the same point is the same every frame
+	float HashPoint(vec3 Point)
+	{
+		return Sampling::ToFloat(Sampling::Hash(std::bit_cast<uint32_t>(Point.x), std::bit_cast<uint32_t>(Point.y), std::bit_cast<uint32_t>(Point.z)));
+	}
+
+	// Computes the intensity of light from point and directional lights at a given point, leaving out ambient light,
+	// and adds how many lights were shaded for it to LightCount
+	// Expects the normal and view direction as unit vectors, and Scene.LightsByType to be up to date
+	template <Accelerator T>
+	float ComputeLighting(const Scene& Scene, const T& Objects, vec3 Point, vec3 Normal, vec3 ViewDirection, std::optional<float> Specular, uint32_t& LightCount)
+	{
+		const LightSet& Lights = Scene.LightsByType;
+		const vec3 ShadowOrigin = Point + Normal * 1e-4f;
+		float Intensity = 0.0f;
+		LightBatch Batch;
+
+		const ShadowCache* Shadows = Scene.CacheShadows && !Scene.Shadows.Empty() ? &Scene.Shadows : nullptr;
+		const ShadowCache::PointKey Key = Shadows ? Shadows->Key(Point, Normal) : ShadowCache::PointKey();
+		ShadowCacheStats ShadowCounts;
+		auto ShadeBatch = [&]
+		{
+			ShadeLightBatch(Scene, Objects, Batch, ShadowOrigin, Normal, ViewDirection, Specular, Shadows, Key, ShadowCounts, Intensity);
+			LightCount += static_cast<uint32_t>(Batch.Count);
+			Batch.Count = 0;
+		};
+		auto AddPointLight = [&](uint32_t Light, float Scale)
+		{
+			SetPointLight(Batch, Batch.Count++, Lights, Light, Point, Normal, Scale);
+			if (Batch.Count == LIGHT_BATCH_SIZE)
+				ShadeBatch();
+		};
+
+		// Point lights; their directions must be computed, and only blockers between the point and the light count
+		const size_t Samples = static_cast<size_t>(std::max(Scene.LightSamples, 0));
+		if (Samples > 0 && !Lights.PointTree.Empty())
+		{
+			// Each sample stands in for the whole set, weighted by one over its probability; the samples are
+			// stratified, each taking its own slice of [0, 1) shifted by the same random offset
+			const float Offset = HashPoint(Point);
+			for (size_t Sample = 0; Sample < Samples; Sample++)
+			{
+				float Pdf;
+				const uint32_t Light = Lights.PointTree.Sample(Point, Normal, (Sample + Offset) / Samples, Pdf);
+				if (Light != LightTree::NO_LIGHT)
+					AddPointLight(Light, 1.0f / (Pdf * Samples));
+			}
+		}
+		else
+		{
+			for (uint32_t Light : Lights.UnboundedPoints)
+				AddPointLight(Light, 1.0f);
+
+			// Lights with falloff only count when the point is inside their sphere of influence
+			Lights.BoundedPointGrid.ForEachAt(Point, [&](uint32_t Index)
+			{
+				const uint32_t Light = Lights.BoundedPoints[Index];
+				const float x = Lights.PointX[Light] - Point.x;
+				const float y = Lights.PointY[Light] - Point.y;
+				const float z = Lights.PointZ[Light] - Point.z;
+				const float Radius = Lights.PointRadius[Light];
+				if (x * x + y * y + z * z < Radius * Radius)
+					AddPointLight(Light, 1.0f);
+			});
+		}
+		if (Batch.Count > 0)
+			ShadeBatch();
+
+		// Directional lights; the direction is already known and blockers anywhere along it count
+		for (size_t First = 0; First < Lights.DirectionalX.size(); First += LIGHT_BATCH_SIZE)
+		{
+			Batch.Count = std::min(LIGHT_BATCH_SIZE, Lights.DirectionalX.size() - First);
+			for (size_t i = 0; i < Batch.Count; i++)
+			{
+				Batch.Intensity[i] = Lights.DirectionalIntensity[First + i];
+				Batch.LightId[i] = static_cast<uint32_t>(Lights.PointX.size() + First + i);
+				Batch.DirectionX[i] = Lights.DirectionalX[First + i];
+				Batch.DirectionY[i] = Lights.DirectionalY[First + i];
+				Batch.DirectionZ[i] = Lights.DirectionalZ[First + i];
+				Batch.Distance[i] = std::numeric_limits<float>::max();
+				Batch.NormalDotDirection[i] = Normal.x * Batch.DirectionX[i] + Normal.y * Batch.DirectionY[i] + Normal.z * Batch.DirectionZ[i];
+			}
+			ShadeBatch();
 		}
 
+		if (Shadows)
+			Shadows->Count(ShadowCounts);
 		return Intensity;
 	}
 }
 
+void Scene::UpdateAcceleration()
+{
+	LastUpdate = AccelerationStats();
+
+	LightsByType = LightSet();
+	for (const Light& l : Lights)
+	{
+		switch (l.Type)
+		{
+		case LightType::Ambient:
+			LightsByType.Ambient += l.Intensity;
+			break;
+		case LightType::Point:
+			LightsByType.PointX.push_back(l.Position.x);
+			LightsByType.PointY.push_back(l.Position.y);
+			LightsByType.PointZ.push_back(l.Position.z);
+			LightsByType.PointIntensity.push_back(l.Intensity);
+			LightsByType.PointRadius.push_back(l.InfluenceRadius(LightCutoff));
+			break;
+		case LightType::Directional:
+		{
+			const vec3 Direction = VecUtils::normalize(l.Direction);
+			LightsByType.DirectionalX.push_back(Direction.x);
+			LightsByType.DirectionalY.push_back(Direction.y);
+			LightsByType.DirectionalZ.push_back(Direction.z);
+			LightsByType.DirectionalIntensity.push_back(l.Intensity);
+			break;
+		}
+		}
+	}
+	if (LightSamples > 0 && LightsByType.PointX.size() > static_cast<size_t>(LightSamples))
+		LightsByType.PointTree.Build(LightsByType.PointX, LightsByType.PointY, LightsByType.PointZ, LightsByType.PointIntensity);
+
+	// Lights too dim to reach past the cutoff anywhere are left out of both lists
+	std::vector<AABB> InfluenceBounds;
+	for (uint32_t i = 0; i < LightsByType.PointRadius.size(); i++)
+	{
+		const float Radius = LightsByType.PointRadius[i];
+		if (Radius == std::numeric_limits<float>::infinity())
+		{
+			LightsByType.UnboundedPoints.push_back(i);
+		}
+		else if (Radius > 0.0f)
+		{
+			const vec3 Position = vec3(LightsByType.PointX[i], LightsByType.PointY[i], LightsByType.PointZ[i]);
+			LightsByType.BoundedPoints.push_back(i);
+			InfluenceBounds.emplace_back(Position - vec3(Radius, Radius, Radius), Position + vec3(Radius, Radius, Radius));
+		}
+	}
+	LightsByType.BoundedPointGrid.Build(InfluenceBounds);
+
+	// Times an acceleration structure update and books it as a build or a refit depending on what it ended up doing
+	// Update returns whether it rebuilt
+	auto TimedUpdate = [this](auto&& Update)
+	{
+		auto StartTime = std::chrono::high_resolution_clock::now();
+		bool Rebuilt = Update();
+		auto StopTime = std::chrono::high_resolution_clock::now();
+
+		double Ms = std::chrono::duration<double, std::milli>(StopTime - StartTime).count();
+		(Rebuilt ? LastUpdate.BuildMs : LastUpdate.RefitMs) += Ms;
+		(Rebuilt ? LastUpdate.Rebuilds : LastUpdate.Refits)++;
+	};
+
+	// Bottom level; untouched meshes are skipped entirely
+	// Returns whether the mesh changed, since its bounds alone don't show that
+	auto UpdateMesh = [&](TriangleMesh& Mesh)
+	{
+		if (!Mesh.Triangles.Empty() && !Mesh.NeedsRefit)
+			return false;
+		Mesh.ComputeBounds();
+		TimedUpdate([&] { return Mesh.Triangles.Update(Mesh.TriangleBounds(), BuildQuality); });
+		Mesh.NeedsRefit = false;
+		return true;
+	};
+	std::vector<AABB> Reshaped;
+	for (TriangleMesh& Mesh : Meshes)
+	{
+		if (UpdateMesh(Mesh))
+			Reshaped.push_back(Mesh.Bounds);
+	}
+	std::vector<bool> SharedReshaped(SharedMeshes.size());
+	for (size_t i = 0; i < SharedMeshes.size(); i++)
+		SharedReshaped[i] = UpdateMesh(SharedMeshes[i]);
+
+	// Top level; cheap enough to refresh every frame
+	ObjectList.clear();
+	std::vector<AABB> ObjectBounds;
+	ObjectBounds.reserve(Spheres.size() + Meshes.size() + Instances.size());
+	for (uint32_t i = 0; i < Spheres.size(); i++)
+	{
+		Spheres[i].UpdateConstants();
+		const vec3 Extent = vec3(Spheres[i].Radius, Spheres[i].Radius, Spheres[i].Radius);
+		ObjectList.push_back({ SceneObject::ObjectType::Sphere, i });
+		ObjectBounds.emplace_back(Spheres[i].Origin - Extent, Spheres[i].Origin + Extent);
+	}
+	for (uint32_t i = 0; i < Meshes.size(); i++)
+	{
+		ObjectList.push_back({ SceneObject::ObjectType::Mesh, i });
+		ObjectBounds.push_back(Meshes[i].Bounds);
+	}
+	for (uint32_t i = 0; i < Instances.size(); i++)
+	{
+		Instances[i].UpdateBounds(SharedMeshes[Instances[i].MeshIndex]);
+		ObjectList.push_back({ SceneObject::ObjectType::Instance, i });
+		ObjectBounds.push_back(Instances[i].Bounds);
+		if (SharedReshaped[Instances[i].MeshIndex])
+			Reshaped.push_back(Instances[i].Bounds);
+	}
+
+	if (CacheShadows)
+		Shadows.Update(LightsByType, ObjectBounds, Reshaped);
+	else
+		Shadows.Release();
+	if (Objects.index() != static_cast<size_t>(Accelerator))
+	{
+		switch (Accelerator)
+		{
+		case AcceleratorType::Linear:
+			Objects.emplace<LinearScan>();
+			break;
+		case AcceleratorType::BVH:
+			Objects.emplace<BVH>();
+			break;
+		case AcceleratorType::Grid:
+			Objects.emplace<UniformGrid>();
+			break;
+		}
+	}
+	std::visit([&](auto& Structure)
+	{
+		if constexpr (std::is_same_v<std::decay_t<decltype(Structure)>, BVH>)
+			TimedUpdate([&] { return Structure.Update(ObjectBounds, BuildQuality); });
+		else
+			TimedUpdate([&] { return Structure.Update(ObjectBounds); });
+	}, Objects);
+}
+
 namespace Raytracer {
 	// Traces a ray through the scene
-	RayPayload TraceRay(Scene& Scene, Ray R, float TMin, float TMax, int RecursionDepth) 
+	template <Accelerator T>
+	RayPayload TraceRay(const Scene& Scene, const T& Objects, Ray R, float TMin, float TMax, int RecursionDepth)
 	{
-		auto [ClosestT, ClosestSphere] = ClosestIntersection(Scene, R, TMin, TMax);
-		if (!ClosestSphere)
-			return RayPayload(ClosestT, Scene.BackgroundColor);
+		std::optional<RayHit> Hit = ClosestIntersection(Scene, Objects, R, TMin, TMax);
+		if (!Hit)
+			return RayPayload(std::numeric_limits<float>::max(), Scene.BackgroundColor);
 		
 		// Compute local color
-		const vec3 Point = R.Origin + (ClosestT * R.Direction);
-		const vec3 Normal = VecUtils::normalize(Point - ClosestSphere->Origin);
-		color4 LocalColor = ClosestSphere->Color * ComputeLighting(Scene, Point, Normal, -R.Direction, ClosestSphere->Specular);
+		const vec3 Point = R.Origin + (Hit->t * R.Direction);
+		const Material& Mat = *Hit->Mat;
+		uint32_t LightCount = 0;
+		color4 LocalColor = Mat.Color * (Scene.LightsByType.Ambient + ComputeLighting(Scene, Objects, Point, Hit->Normal, -R.Direction, Mat.Specular, LightCount));
 
 		// Check if we should reflect; return if not
-		if (RecursionDepth <= 0 || ClosestSphere->Reflective <= 0.0f)
-			return RayPayload(ClosestT, LocalColor);
+		if (RecursionDepth <= 0 || Mat.Reflective <= 0.0f)
+			return RayPayload(Hit->t, LocalColor, LightCount, Hit->Surface, Hit->Normal, Mat.Color);
 
 		// Recursively compute reflection
-		Ray Reflected = Ray(Point + Normal * 1e-4f, Reflect(-R.Direction, Normal));
-		color4 ReflectedColor = TraceRay(Scene, Reflected, 1e-6, std::numeric_limits<float>::max(), RecursionDepth - 1).Color;
+		Ray Reflected = Ray(Point + Hit->Normal * 1e-4f, Reflect(-R.Direction, Hit->Normal));
+		RayPayload ReflectedPayload = TraceRay(Scene, Objects, Reflected, 1e-6, std::numeric_limits<float>::max(), RecursionDepth - 1);
+
+		return RayPayload(Hit->t, LocalColor * (1 - Mat.Reflective) + ReflectedPayload.Color * Mat.Reflective, LightCount + ReflectedPayload.LightCount, Hit->Surface, Hit->Normal, Mat.Color);
+	}
+
+	template RayPayload TraceRay(const Scene&, const LinearScan&, Ray, float, float, int);
+	template RayPayload TraceRay(const Scene&, const BVH&, Ray, float, float, int);
+	template RayPayload TraceRay(const Scene&, const UniformGrid&, Ray, float, float, int);
+
+	template <Accelerator T>
+	std::optional<RayHit> ClosestHit(const Scene& Scene, const T& Objects, const Ray& R, float TMin, float TMax)
+	{
+		return ClosestIntersection(Scene, Objects, R, TMin, TMax);
+	}
+
+	template std::optional<RayHit> ClosestHit(const Scene&, const LinearScan&, const Ray&, float, float);
+	template std::optional<RayHit> ClosestHit(const Scene&, const BVH&, const Ray&, float, float);
+	template std::optional<RayHit> ClosestHit(const Scene&, const UniformGrid&, const Ray&, float, float);
+
+	template <Accelerator T>
+	float DirectLighting(const Scene& Scene, const T& Objects, vec3 Point, vec3 Normal, vec3 ViewDirection, std::optional<float> Specular, uint32_t& LightCount)
+	{
+		return ComputeLighting(Scene, Objects, Point, Normal, ViewDirection, Specular, LightCount);
+	}
+
+	template float DirectLighting(const Scene&, const LinearScan&, vec3, vec3, vec3, std::optional<float>, uint32_t&);
+	template float DirectLighting(const Scene&, const BVH&, vec3, vec3, vec3, std::optional<float>, uint32_t&);
+	template float DirectLighting(const Scene&, const UniformGrid&, vec3, vec3, vec3, std::optional<float>, uint32_t&);
 
-		return RayPayload(ClosestT, LocalColor * (1 - ClosestSphere->Reflective) + ReflectedColor * ClosestSphere->Reflective);
+	RayPayload TraceRay(const Scene& Scene, Ray R, float TMin, float TMax, int RecursionDepth)
+	{
+		return std::visit([&](const auto& Objects) { return TraceRay(Scene, Objects, R, TMin, TMax, RecursionDepth); }, Scene.Objects);
 	}
-}
\ No newline at end of file
+
+	void PrintSceneStats(const Scene& Scene)
+	{
+		auto MeshBytes = [](const TriangleMesh& m)
+		{
+			return m.Vertices.size() * sizeof(vec3) + m.Indices.size() * sizeof(uint32_t);
+		};
+
+		size_t Triangles = 0;
+		size_t GeometryBytes = 0;
+		for (const TriangleMesh& m : Scene.Meshes)
+		{
+			Triangles += m.TriangleCount();
+			GeometryBytes += MeshBytes(m);
+		}
+
+		// Compare what the instances actually cost against copying the mesh for every instance
+		size_t InstancedTriangles = 0;
+		size_t SharedBytes = 0;
+		size_t FlattenedBytes = 0;
+		for (const TriangleMesh& m : Scene.SharedMeshes)
+			SharedBytes += MeshBytes(m);
+		for (const MeshInstance& Instance : Scene.Instances)
+		{
+			InstancedTriangles += Scene.SharedMeshes[Instance.MeshIndex].TriangleCount();
+			FlattenedBytes += MeshBytes(Scene.SharedMeshes[Instance.MeshIndex]);
+		}
+		const size_t InstancedBytes = SharedBytes + Scene.Instances.size() * sizeof(MeshInstance);
+
+		std::cout << "Scene: " << Scene.Spheres.size() << " spheres, " << Scene.Planes.size() << " planes, "
+			<< Scene.Meshes.size() << " meshes (" << Triangles << " triangles, " << GeometryBytes / 1024 << " KB), "
+			<< Scene.Lights.size() << " lights" << std::endl;
+
+		if (!Scene.Instances.empty())
+		{
+			std::cout << "Instancing: " << Scene.Instances.size() << " instances of " << Scene.SharedMeshes.size() << " meshes ("
+				<< InstancedTriangles << " triangles), " << InstancedBytes / 1024 << " KB instead of " << FlattenedBytes / 1024
+				<< " KB, saving " << (FlattenedBytes > InstancedBytes ? (FlattenedBytes - InstancedBytes) / 1024 : 0) << " KB" << std::endl;
+		}
+	}
+}
@@ -1,8 +1,21 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <vector>
 
 #include "VecUtils.hpp"
+#include "Accelerator.hpp"
+#include "Animation.hpp"
+#include "BVH.hpp"
+#include "Camera.hpp"
 #include "Drawing.hpp"
+#include "Grid.hpp"
+#include "LightTree.hpp"
+#include "ShadowCache.hpp"
+#include "Transform.hpp"
 
 struct Ray
 {
@@ -16,15 +29,32 @@ struct Ray
 		: Origin(Origin),
 		Direction(VecUtils::normalize(Direction)),
 		MaxDistance(MaxDistance) {}
+
+	// For directions that are unit length already, e.g. from Camera::RowDirections
+	static Ray FromUnitDirection(const vec3& Origin, const vec3& Direction)
+	{
+		Ray Result;
+		Result.Origin = Origin;
+		Result.Direction = Direction;
+		return Result;
+	}
 };
 
 struct RayPayload
 {
 	float t;
 	color4 Color;
+	// Lights shaded for this ray, including its reflections
+	uint32_t LightCount;
+	// The surface the ray hit, as in RayHit::Surface
+	const void* Surface;
+	// Unit normal and material color where the ray hit, left at zero for the background; guides for denoising
+	vec3 Normal;
+	color4 Albedo;
 
-	RayPayload(float TValue, const color4& Color)
-		: t(TValue), Color(Color) {}
+	RayPayload(float TValue, const color4& Color, uint32_t LightCount = 0, const void* Surface = nullptr,
+		const vec3& Normal = vec3(0, 0, 0), const color4& Albedo = color4(0, 0, 0, 0))
+		: t(TValue), Color(Color), LightCount(LightCount), Surface(Surface), Normal(Normal), Albedo(Albedo) {}
 };
 
 enum class LightType
@@ -34,14 +64,31 @@ enum class LightType
 	Directional
 };
 
+struct Material
+{
+	color4 Color = Colors::Red;
+	float Reflective = 0.0f;
+	std::optional<float> Specular = std::nullopt;
+
+	Material() = default;
+
+	// If the given value of Specular is negative, Specular will be std::nullopt
+	Material(const color4& Color, float Specular = -1.0f, float Reflective = 0.0f)
+		: Color(Color),
+		Reflective(Reflective),
+		Specular(Specular < 0.0f ? std::nullopt : std::optional<float>(Specular))
+	{}
+};
+
 struct Sphere
 {
 	vec3 Origin = vec3(0, 0, 0);
 	float Radius = 1.0f;
-	color4 Color = Colors::Magenta;
+	Material Mat = Material(Colors::Magenta);
 
-	float Reflective = 0.0f;
-	std::optional<float> Specular = std::nullopt;
+	// Derived from Radius by UpdateConstants, which Scene::UpdateAcceleration calls
+	float RadiusSquared = 1.0f;
+	float InvRadius = 1.0f;
 
 	Sphere() = default;
 
@@ -49,41 +96,399 @@ struct Sphere
 	Sphere(const vec3& Origin = VEC3_ZERO, float Radius = 1.0f, const color4& Color = Colors::Red, float Specular = -1.0f, float Reflective = 0.0f)
 		: Origin(Origin),
 		Radius(Radius),
-		Color(Color),
-		Specular(Specular < 0.0f ? std::nullopt : std::optional<float>(Specular)),
-		Reflective(Reflective)
+		Mat(Color, Specular, Reflective)
+	{
+		UpdateConstants();
+	}
+
+	void UpdateConstants()
+	{
+		RadiusSquared = Radius * Radius;
+		InvRadius = 1.0f / Radius;
+	}
+
+	// Distance to the nearest intersection beyond TMin, or max float if there is none
+	// Expects a unit length ray direction, which the Ray constructor guarantees
+	float Intersect(const Ray& Ray, float TMin) const
+	{
+		// Half of b, and the discriminant as r^2 minus the squared distance from the center to the ray's line;
+		// unlike b^2 - 4ac that doesn't lose its precision to cancellation for small or distant spheres
+		// Written out per component, since the generic vector operators don't optimize well in this hot a loop
+		const float x = Origin.x - Ray.Origin.x;
+		const float y = Origin.y - Ray.Origin.y;
+		const float z = Origin.z - Ray.Origin.z;
+		const float HalfB = x * Ray.Direction.x + y * Ray.Direction.y + z * Ray.Direction.z;
+		const float ClosestX = x - HalfB * Ray.Direction.x;
+		const float ClosestY = y - HalfB * Ray.Direction.y;
+		const float ClosestZ = z - HalfB * Ray.Direction.z;
+		const float Discriminant = RadiusSquared - (ClosestX * ClosestX + ClosestY * ClosestY + ClosestZ * ClosestZ);
+		if (Discriminant < 0.0f)
+			return std::numeric_limits<float>::max();
+
+		// The root with the larger magnitude comes straight from q; the other follows from t1 * t2 = c
+		const float q = HalfB + std::copysign(std::sqrt(Discriminant), HalfB);
+		const float c = x * x + y * y + z * z - RadiusSquared;
+		float tNear = c / q;
+		float tFar = q;
+		if (tNear > tFar)
+			std::swap(tNear, tFar);
+		if (tNear > TMin)
+			return tNear;
+		return tFar > TMin ? tFar : std::numeric_limits<float>::max();
+	}
+
+	// Unit normal at a point on the surface
+	vec3 Normal(const vec3& Point) const
+	{
+		return (Point - Origin) * InvRadius;
+	}
+};
+
+// Infinite plane through Point
+struct Plane
+{
+	vec3 Point = vec3(0, 0, 0);
+	vec3 Normal = vec3(0, 1, 0);
+	Material Mat = Material(Colors::Magenta);
+
+	Plane() = default;
+
+	// Normal doesn't need to be unit length; it is normalized here
+	Plane(const vec3& Point, const vec3& Normal = vec3(0.0f, 1.0f, 0.0f), const color4& Color = Colors::Red, float Specular = -1.0f, float Reflective = 0.0f)
+		: Point(Point),
+		Normal(VecUtils::normalize(Normal)),
+		Mat(Color, Specular, Reflective)
 	{}
 };
 
+// Indexed triangle list sharing a single material
+struct TriangleMesh
+{
+	std::vector<vec3> Vertices{};
+	// Three vertex indices per triangle
+	std::vector<uint32_t> Indices{};
+	Material Mat = Material(Colors::Magenta);
+
+	// Bounds of all vertices; kept up to date by Scene::UpdateAcceleration
+	AABB Bounds;
+	// Bottom level acceleration structure over the triangles
+	BVH Triangles{};
+	// Set after moving vertices (but not changing Indices) to have the next update refit Triangles
+	bool NeedsRefit = false;
+
+	size_t TriangleCount() const { return Indices.size() / 3; }
+
+	void ComputeBounds()
+	{
+		Bounds = AABB();
+		for (const vec3& v : Vertices)
+			Bounds.Grow(v);
+	}
+
+	std::vector<AABB> TriangleBounds() const
+	{
+		std::vector<AABB> Result(TriangleCount());
+		for (size_t i = 0; i < Result.size(); i++)
+		{
+			Result[i].Grow(Vertices[Indices[i * 3]]);
+			Result[i].Grow(Vertices[Indices[i * 3 + 1]]);
+			Result[i].Grow(Vertices[Indices[i * 3 + 2]]);
+		}
+		return Result;
+	}
+};
+
+// A placed copy of one of the scene's shared meshes
+// Rays are moved into the mesh's space for intersection, so the geometry is never duplicated
+struct MeshInstance
+{
+	// Index into Scene::SharedMeshes
+	uint32_t MeshIndex = 0;
+	Transform ObjectToWorld;
+	Transform WorldToObject;
+	// Replaces the mesh's own material when set
+	std::optional<Material> MaterialOverride = std::nullopt;
+
+	// World space bounds of the transformed mesh
+	AABB Bounds;
+
+	// World bounds enclose all eight transformed corners of the mesh bounds
+	void UpdateBounds(const TriangleMesh& Mesh)
+	{
+		Bounds = AABB();
+		if (Mesh.Vertices.empty())
+			return;
+		for (int Corner = 0; Corner < 8; Corner++)
+		{
+			Bounds.Grow(ObjectToWorld.TransformPoint(vec3(
+				Corner & 1 ? Mesh.Bounds.Max.x : Mesh.Bounds.Min.x,
+				Corner & 2 ? Mesh.Bounds.Max.y : Mesh.Bounds.Min.y,
+				Corner & 4 ? Mesh.Bounds.Max.z : Mesh.Bounds.Min.z)));
+		}
+	}
+};
+
+// Entry in the scene's top level acceleration structure
+struct SceneObject
+{
+	enum class ObjectType { Sphere, Mesh, Instance };
+
+	ObjectType Type = ObjectType::Sphere;
+	// Index into Spheres, Meshes or Instances
+	uint32_t Index = 0;
+};
+
+// What the last Scene::UpdateAcceleration call did and how long it took
+struct AccelerationStats
+{
+	double BuildMs = 0.0;
+	double RefitMs = 0.0;
+	int Rebuilds = 0;
+	int Refits = 0;
+};
+
+// Adaptive anti-aliasing; every pixel gets one sample, then pixels that differ too much from a neighbour
+// or see a different surface are sampled again on a jittered grid
+struct AntiAliasingSettings
+{
+	// Extra samples for an edge pixel, rounded down to a square; 0 turns anti-aliasing off
+	int EdgeSamples = 0;
+	// Difference in displayed luminance, from 0 to 1, past which neighbouring pixels count as an edge
+	float ContrastThreshold = 0.1f;
+	// Refines every pixel rather than just the edges, supersampling the whole frame; for reference images
+	bool RefineAll = false;
+};
+
+// Full quality only within a rectangle of the frame, for looking at one area at a time; the rest is traced sparsely,
+// with shallower reflections, and interpolated
+struct RegionSettings
+{
+	bool Enabled = false;
+	// The rectangle in pixels, from its top left corner; the viewer centers it on the mouse unless FollowMouse is off
+	int Left = 136;
+	int Top = 136;
+	int Width = 128;
+	int Height = 128;
+	bool FollowMouse = true;
+	// Outside the rectangle only every Stride-th pixel along each axis is traced, with reflections OutsideDepth
+	// bounces deep instead of Raytracer::MAX_RECURSION_DEPTH
+	int Stride = 4;
+	int OutsideDepth = 1;
+
+	bool Contains(int x, int y) const { return x >= Left && x < Left + Width && y >= Top && y < Top + Height; }
+};
+
+// Blending frames over time in the viewer, see TemporalAccumulator
+struct TemporalSettings
+{
+	bool Enabled = false;
+	// Frames a pixel averages over while the camera stays still; 1 / MaxHistory is the weight of the newest frame
+	// At most HISTORY_LIMIT, which is what the per pixel history lengths can count to
+	int MaxHistory = 64;
+	// Same, while the camera moves; reprojected history lags behind view dependent shading like reflections, so it is kept short
+	int MotionHistory = 3;
+	// Reprojected history is rejected where its stored depth differs from the expected one by more than this
+	// fraction, which is where a surface came into view
+	float DepthTolerance = 0.05f;
+
+	static constexpr int HISTORY_LIMIT = 65535;
+};
+
+// Tracing half of the pixels each frame, see CheckerboardReconstructor
+struct CheckerboardSettings
+{
+	bool Enabled = false;
+	// How far, relative to the depth of the point, last frame's pixels may be from where a missing pixel is
+	// expected to be and still fill it in
+	float DepthTolerance = 0.05f;
+};
+
+// Edge-aware smoothing of the finished frame, see Denoiser
+struct DenoiseSettings
+{
+	bool Enabled = false;
+	// Passes of the filter; each one spaces its taps twice as far apart, so it reaches 2^(Iterations + 1) pixels out
+	// At most MAX_ITERATIONS
+	int Iterations = 3;
+	// How different neighbours may be before they stop being averaged in: in displayed luminance (halved every
+	// pass, as later passes see smoother input), in depth relative to the pixel's and per pass, in albedo,
+	// and in the distance between unit normals
+	float ColorSigma = 1.5f;
+	float DepthSigma = 0.05f;
+	float AlbedoSigma = 0.1f;
+	float NormalSigma = 0.1f;
+
+	static constexpr int MAX_ITERATIONS = 10;
+};
+
+// Progressive path tracing in place of the Whitted style TraceRay, see PathTracer
+struct PathTracingSettings
+{
+	bool Enabled = false;
+	// Images are reproducible for the same seed, pass count and scene, whatever the thread count
+	uint32_t Seed = 1;
+	// Paths always last this many bounces before Russian roulette may end them
+	int MinBounces = 3;
+	int MaxBounces = 64;
+};
+
+// Closest surface hit along a ray
+struct RayHit
+{
+	float t = std::numeric_limits<float>::max();
+	// Unit surface normal, facing the side the ray came from for meshes and planes
+	vec3 Normal = vec3(0, 1, 0);
+	const Material* Mat = nullptr;
+	// Tells objects apart, only meant for comparing; instances of the same mesh are different surfaces
+	const void* Surface = nullptr;
+};
+
 struct Light
 {
 	LightType Type = LightType::Point;
 	float Intensity = 1.0f;
 	vec3 Position = vec3(0.0f, 0.0f, 0.0f);
 	vec3 Direction = vec3(1.0f, 0.0f, 0.0f);
+	// Point lights only; with falloff the light fades as Intensity / (1 + distance^2), windowed down to nothing
+	// at its influence radius, instead of reaching every point at full strength
+	bool Falloff = false;
 
 	Light() = default;
-	Light(LightType Type, const float Intensity, const vec3& Position, const vec3& Direction) :
+	Light(LightType Type, const float Intensity, const vec3& Position, const vec3& Direction, bool Falloff = false) :
 		Type(Type),
 		Intensity(Intensity),
 		Position(Position), 
-		Direction(Direction) {}
+		Direction(Direction),
+		Falloff(Falloff) {}
+
+	// Distance past which a light with falloff would add less than Cutoff; infinite for lights without falloff
+	float InfluenceRadius(float Cutoff) const
+	{
+		if (!Falloff)
+			return std::numeric_limits<float>::infinity();
+		return std::sqrt(std::max(Intensity / Cutoff - 1.0f, 0.0f));
+	}
+};
+
+// Scene lights split up by type, so shading runs one tight loop per type instead of branching per light
+// Each light type is stored as one array per component, which lets the per-light math vectorize
+struct LightSet
+{
+	// Sum of every ambient light, which is the same at every point
+	float Ambient = 0.0f;
+
+	std::vector<float> PointX{};
+	std::vector<float> PointY{};
+	std::vector<float> PointZ{};
+	std::vector<float> PointIntensity{};
+	// Influence radius of every point light, infinite for lights without falloff
+	std::vector<float> PointRadius{};
+
+	// Point lights without falloff reach everywhere, so exact shading always evaluates all of them
+	std::vector<uint32_t> UnboundedPoints{};
+	// Point lights with falloff, indexed by the boxes around their spheres of influence so a shading point only
+	// looks at the lights of its own cell; grid primitive i is point light BoundedPoints[i]
+	std::vector<uint32_t> BoundedPoints{};
+	UniformGrid BoundedPointGrid{};
+
+	// Unit directions towards the light
+	std::vector<float> DirectionalX{};
+	std::vector<float> DirectionalY{};
+	std::vector<float> DirectionalZ{};
+	std::vector<float> DirectionalIntensity{};
+
+	// Over the point lights; only built when Scene::LightSamples asks for fewer lights than there are
+	LightTree PointTree{};
 };
 
 struct Scene
 {
 	color4 BackgroundColor = Colors::White;
-	vec3 Origin = vec3(0, 0, 0);
+	::Camera Camera{};
+	// Moves the spheres, lights, instances and camera over time; anything without keyframes stays as loaded
+	::Animation Animation{};
 
 	// Objects in the scene
 	std::vector<Sphere> Spheres{};
+	std::vector<Plane> Planes{};
+	std::vector<TriangleMesh> Meshes{};
 	std::vector<Light> Lights{};
 
+	// Geometry that is only visible through instances of it
+	std::vector<TriangleMesh> SharedMeshes{};
+	std::vector<MeshInstance> Instances{};
+
+	// Two level acceleration structure: Objects is built over every sphere, mesh and instance
+	// (planes are unbounded and tested separately), and each mesh has its own BVH of triangles
+	// Objects holds whichever structure Accelerator asks for as of the last UpdateAcceleration
+	AnyAccelerator Objects{};
+	std::vector<SceneObject> ObjectList{};
+	AccelerationStats LastUpdate{};
+	AcceleratorType Accelerator = AcceleratorType::BVH;
+	BVHBuildQuality BuildQuality = BVHBuildQuality::High;
+
+	// Lights partitioned by type; rebuilt from Lights by UpdateAcceleration
+	LightSet LightsByType{};
+	// Point lights sampled per shading point through LightsByType.PointTree, picked by their estimated contribution
+	// 0 evaluates every light, as do scenes with no more point lights than this
+	int LightSamples = 0;
+	// Intensity below which a light with falloff is considered not to reach a point; sets their influence radii
+	float LightCutoff = 0.01f;
+
+	AntiAliasingSettings AntiAliasing{};
+	RegionSettings Region{};
+	PathTracingSettings PathTracing{};
+	TemporalSettings Temporal{};
+	CheckerboardSettings Checkerboard{};
+	DenoiseSettings Denoise{};
+
+	// Raises the specular term with ShadingMath::Pow instead of std::pow; within ShadingMath::POW_MAX_RELATIVE_ERROR of it
+	bool FastSpecular = true;
+
+	// Reuses shadow ray results from earlier frames where the lights and geometry haven't changed; off by default
+	// since it blurs shadow edges to Shadows.CellSize
+	bool CacheShadows = false;
+	ShadowCache Shadows{};
+
+	// Brings the acceleration structures and LightsByType up to date; must be called before tracing whenever the scene changed
+	// Meshes are only rebuilt when new or when NeedsRefit is set and refitting degraded them too much
+	void UpdateAcceleration();
+
 	Sphere AddSphere(const vec3& Origin = vec3(0.0f, 0.0f, 0.0f), float Radius = 1.0f, const color4& Color = Colors::Red, float Specular = -1.0f, float Reflective = 0.0f)
 	{
 		return Spheres.emplace_back(Origin, Radius, Color, Specular, Reflective);
 	}
 
+	Plane AddPlane(const vec3& Point = vec3(0.0f, 0.0f, 0.0f), const vec3& Normal = vec3(0.0f, 1.0f, 0.0f), const color4& Color = Colors::Red, float Specular = -1.0f, float Reflective = 0.0f)
+	{
+		return Planes.emplace_back(Point, Normal, Color, Specular, Reflective);
+	}
+
+	TriangleMesh& AddMesh(TriangleMesh Mesh)
+	{
+		Mesh.ComputeBounds();
+		return Meshes.emplace_back(std::move(Mesh));
+	}
+
+	// Returns the index to pass to AddInstance
+	uint32_t AddSharedMesh(TriangleMesh Mesh)
+	{
+		Mesh.ComputeBounds();
+		SharedMeshes.push_back(std::move(Mesh));
+		return static_cast<uint32_t>(SharedMeshes.size() - 1);
+	}
+
+	MeshInstance& AddInstance(uint32_t MeshIndex, const Transform& ObjectToWorld, std::optional<Material> MaterialOverride = std::nullopt)
+	{
+		MeshInstance& Instance = Instances.emplace_back();
+		Instance.MeshIndex = MeshIndex;
+		Instance.ObjectToWorld = ObjectToWorld;
+		Instance.WorldToObject = ObjectToWorld.Inverse();
+		Instance.MaterialOverride = MaterialOverride;
+		Instance.UpdateBounds(SharedMeshes[MeshIndex]);
+		return Instance;
+	}
+
 	Light AddLight(LightType Type, float Intensity = 1.0f, const vec3& Position = vec3(0.0f, 0.0f, 0.0f), const vec3& Direction = vec3(1.0f, 0.0f, 0.0f))
 	{
 		return Lights.emplace_back(Type, Intensity, Position, Direction);
@@ -94,9 +499,9 @@ struct Scene
 		return AddLight(LightType::Ambient, Intensity);
 	}
 
-	Light AddPointLight(float Intensity = 1.0f, const vec3& Position = vec3(0.0f, 0.0f, 0.0f))
+	Light AddPointLight(float Intensity = 1.0f, const vec3& Position = vec3(0.0f, 0.0f, 0.0f), bool Falloff = false)
 	{
-		return AddLight(LightType::Point, Intensity, Position);
+		return Lights.emplace_back(LightType::Point, Intensity, Position, vec3(1.0f, 0.0f, 0.0f), Falloff);
 	}
 
 	Light AddDirectionalLight(float Intensity = 1.0f, const vec3& Direction = vec3(1.0f, 0.0f, 0.0f))
@@ -108,5 +513,26 @@ struct Scene
 namespace Raytracer {
 	constexpr int MAX_RECURSION_DEPTH = 3;
 
-	RayPayload TraceRay(Scene& Scene, Ray Ray, float TMin = 1e-6, float TMax = std::numeric_limits<float>::max(), int RecursionDepth = MAX_RECURSION_DEPTH);
+	// Traces a ray through the scene with the top level structure's type fixed at compile time, so its traversal
+	// is inlined into everything the ray does; Objects must be the scene's current structure
+	// Instantiated for LinearScan, BVH and UniformGrid
+	template <Accelerator T>
+	RayPayload TraceRay(const Scene& Scene, const T& Objects, Ray Ray, float TMin = 1e-6, float TMax = std::numeric_limits<float>::max(), int RecursionDepth = MAX_RECURSION_DEPTH);
+
+	// Closest surface along the ray between TMin and TMax, with its normal and material
+	// Instantiated like TraceRay, for integrators that follow rays themselves
+	template <Accelerator T>
+	std::optional<RayHit> ClosestHit(const Scene& Scene, const T& Objects, const Ray& Ray, float TMin, float TMax);
+
+	// Intensity of the light reaching a point straight from the point and directional lights, shadows included,
+	// shaded the way TraceRay shades; ambient light is left out. Adds the number of lights shaded to LightCount
+	// Goes through the shadow cache when Scene.CacheShadows is set
+	template <Accelerator T>
+	float DirectLighting(const Scene& Scene, const T& Objects, vec3 Point, vec3 Normal, vec3 ViewDirection, std::optional<float> Specular, uint32_t& LightCount);
+
+	// Picks the TraceRay specialization for whichever structure the scene currently holds
+	RayPayload TraceRay(const Scene& Scene, Ray Ray, float TMin = 1e-6, float TMax = std::numeric_limits<float>::max(), int RecursionDepth = MAX_RECURSION_DEPTH);
+
+	// Prints object counts and geometry memory, including what instancing saves
+	void PrintSceneStats(const Scene& Scene);
 }
\ No newline at end of file
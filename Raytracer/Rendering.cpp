@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Drawing.hpp"
+#include "Parallel.hpp"
+#include "Rendering.hpp"
+#include "Sampling.hpp"
+
+FrameStats Rendering::Render(Scene& Scene, Framebuffer& Frame, vec2 Jitter, PixelSet Pixels)
+{
+	Frame.Resize(Drawing::ResX, Drawing::ResY);
+	Scene.Camera.Update(Frame.Width, Frame.Height);
+	const Camera& View = Scene.Camera;
+	const int Width = Frame.Width;
+	const int Height = Frame.Height;
+	const size_t PixelCount = Frame.Pixels.size();
+	std::vector<uint32_t> PixelLights(PixelCount, 0);
+
+	// Rows are split into ranges traced on threads of their own; each range counts its own samples
+	const size_t Ranges = Parallel::RangeCount(Height, 8);
+	std::vector<uint64_t> RangeSamples(Ranges, 0);
+
+	// Outside the region, only the pixels on a grid Stride apart are traced
+	const RegionSettings& Region = Scene.Region;
+	const bool UseRegion = Region.Enabled && Pixels == PixelSet::All;
+	const int Stride = UseRegion ? std::max(Region.Stride, 1) : 1;
+	auto Outside = [&](int x, int y) { return UseRegion && !Region.Contains(x, y); };
+
+	auto Trace = [&](int x, int y, const Ray& R, int RecursionDepth = Raytracer::MAX_RECURSION_DEPTH)
+	{
+		RayPayload Result = Raytracer::TraceRay(Scene, R, 1e-6f, std::numeric_limits<float>::max(), RecursionDepth);
+		PixelLights[size_t(y) * Width + x] += Result.LightCount;
+		return Result;
+	};
+
+	// First samples are generated a row at a time
+	Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t Range)
+	{
+		std::vector<float> DirectionX(Width);
+		std::vector<float> DirectionY(Width);
+		std::vector<float> DirectionZ(Width);
+		uint64_t Samples = 0;
+		for (int y = static_cast<int>(Begin); y < static_cast<int>(End); y++)
+		{
+			View.RowDirections(y, 0, Width, Jitter.x, Jitter.y, DirectionX.data(), DirectionY.data(), DirectionZ.data());
+			for (int x = 0; x < Width; x++)
+			{
+				if (Pixels != PixelSet::All && ((x + y) & 1) != (Pixels == PixelSet::Odd))
+					continue;
+				const bool Sparse = Outside(x, y);
+				if (Sparse && (x % Stride != 0 || y % Stride != 0))
+					continue;
+				const size_t i = size_t(y) * Width + x;
+				const Ray R = Ray::FromUnitDirection(View.Position, vec3(DirectionX[x], DirectionY[x], DirectionZ[x]));
+				RayPayload Result = Trace(x, y, R, Sparse ? Region.OutsideDepth : Raytracer::MAX_RECURSION_DEPTH);
+				Samples++;
+				Frame.Pixels[i] = Result.Color;
+				Frame.Surfaces[i] = Result.Surface;
+				Frame.Depth[i] = Result.t;
+				Frame.Normals[i] = Result.Normal;
+				Frame.Albedo[i] = Result.Albedo;
+			}
+		}
+		RangeSamples[Range] += Samples;
+	});
+
+	// The untraced pixels outside the region blend the four traced ones around them; past the last row or column
+	// of the grid, the nearest one is repeated. The guides come from the nearest of them
+	if (UseRegion && Stride > 1)
+	{
+		const int LastX = (Width - 1) / Stride * Stride;
+		const int LastY = (Height - 1) / Stride * Stride;
+		Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t)
+		{
+			for (int y = static_cast<int>(Begin); y < static_cast<int>(End); y++)
+			{
+				for (int x = 0; x < Width; x++)
+				{
+					if (!Outside(x, y) || (x % Stride == 0 && y % Stride == 0))
+						continue;
+					const int x0 = x / Stride * Stride;
+					const int y0 = y / Stride * Stride;
+					const int x1 = std::min(x0 + Stride, LastX);
+					const int y1 = std::min(y0 + Stride, LastY);
+					const float fx = x1 > x0 ? static_cast<float>(x - x0) / Stride : 0.0f;
+					const float fy = y1 > y0 ? static_cast<float>(y - y0) / Stride : 0.0f;
+					const color4 Top = Frame.At(x0, y0) * (1.0f - fx) + Frame.At(x1, y0) * fx;
+					const color4 Bottom = Frame.At(x0, y1) * (1.0f - fx) + Frame.At(x1, y1) * fx;
+
+					const size_t i = size_t(y) * Width + x;
+					const size_t Nearest = size_t(fy < 0.5f ? y0 : y1) * Width + (fx < 0.5f ? x0 : x1);
+					Frame.Pixels[i] = Top * (1.0f - fy) + Bottom * fy;
+					Frame.Surfaces[i] = Frame.Surfaces[Nearest];
+					Frame.Depth[i] = Frame.Depth[Nearest];
+					Frame.Normals[i] = Frame.Normals[Nearest];
+					Frame.Albedo[i] = Frame.Albedo[Nearest];
+				}
+			}
+		});
+	}
+
+	// Edges are found from the first samples only, before any pixel is refined, so refinement doesn't creep outwards
+	// Half frames have no neighbours to find edges with
+	const AntiAliasingSettings& Settings = Scene.AntiAliasing;
+	const int Strata = Pixels != PixelSet::All ? 0 : static_cast<int>(std::sqrt(static_cast<float>(std::max(Settings.EdgeSamples, 0))));
+	size_t Refined = 0;
+	if (Strata > 0)
+	{
+		std::vector<float> Luminance(PixelCount);
+		Parallel::For(PixelCount, [&](size_t i) { Luminance[i] = Drawing::DisplayLuminance(Frame.Pixels[i]); });
+
+		// A pixel is on an edge if it differs from any of its four neighbours; each pixel only marks itself, so
+		// ranges never write to the same entries
+		std::vector<uint8_t> Edge(PixelCount, 0);
+		auto Differs = [&](size_t a, size_t b)
+		{
+			return Frame.Surfaces[a] != Frame.Surfaces[b] || std::abs(Luminance[a] - Luminance[b]) > Settings.ContrastThreshold;
+		};
+		Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t)
+		{
+			for (int y = static_cast<int>(Begin); y < static_cast<int>(End); y++)
+			{
+				for (int x = 0; x < Width; x++)
+				{
+					if (Outside(x, y))
+						continue;
+					const size_t i = size_t(y) * Width + x;
+					Edge[i] = Settings.RefineAll
+						|| (x > 0 && !Outside(x - 1, y) && Differs(i, i - 1))
+						|| (x + 1 < Width && !Outside(x + 1, y) && Differs(i, i + 1))
+						|| (y > 0 && !Outside(x, y - 1) && Differs(i, i - Width))
+						|| (y + 1 < Height && !Outside(x, y + 1) && Differs(i, i + Width));
+				}
+			}
+		});
+
+		// The edge pixels are gathered first and split evenly between the threads, since edges bunch up in parts
+		// of the image and splitting by rows would leave some threads with most of the work
+		std::vector<uint32_t> EdgePixels;
+		for (size_t i = 0; i < PixelCount; i++)
+		{
+			if (Edge[i])
+				EdgePixels.push_back(static_cast<uint32_t>(i));
+		}
+		Refined = EdgePixels.size();
+
+		// One jittered sample in each cell of a Strata x Strata grid over the pixel, averaged with the first sample
+		const size_t RefineRanges = std::min(Parallel::RangeCount(EdgePixels.size(), 64), Ranges);
+		Parallel::ForRanges(EdgePixels.size(), RefineRanges, [&](size_t Begin, size_t End, size_t Range)
+		{
+			for (size_t e = Begin; e < End; e++)
+			{
+				const int x = static_cast<int>(EdgePixels[e] % Width);
+				const int y = static_cast<int>(EdgePixels[e] / Width);
+				color4 Sum = Frame.At(x, y);
+				for (int Cell = 0; Cell < Strata * Strata; Cell++)
+				{
+					// Keyed by pixel and cell only, so samples are jittered the same way every frame
+					Sampling::Random Rng(0, static_cast<uint32_t>(y * Width + x), Cell);
+					const float OffsetX = (Cell % Strata + Rng.Next()) / Strata - 0.5f;
+					const float OffsetY = (Cell / Strata + Rng.Next()) / Strata - 0.5f;
+					Sum = Sum + Trace(x, y, Ray(View.Position, View.PixelDirection(x + OffsetX, y + OffsetY))).Color;
+				}
+				Frame.At(x, y) = Sum * (1.0f / (Strata * Strata + 1));
+			}
+			RangeSamples[Range] += uint64_t(End - Begin) * Strata * Strata;
+		});
+	}
+
+	FrameStats Stats;
+	uint64_t Lights = 0;
+	for (uint32_t Count : PixelLights)
+	{
+		Lights += Count;
+		Stats.MaxPixelLights = std::max(Stats.MaxPixelLights, Count);
+	}
+	uint64_t Samples = 0;
+	for (uint64_t Count : RangeSamples)
+		Samples += Count;
+	Stats.SamplesPerPixel = static_cast<double>(Samples) / PixelCount;
+	Stats.RefinedPixels = static_cast<double>(Refined) / PixelCount;
+	Stats.LightsPerPixel = static_cast<double>(Lights) / PixelCount;
+	return Stats;
+}
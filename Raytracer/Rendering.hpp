@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Raytracer.hpp"
+
+// A rendered image, row by row from the top left
+struct Framebuffer
+{
+	int Width = 0;
+	int Height = 0;
+	std::vector<color4> Pixels{};
+	// The surface each pixel's first sample hit, nullptr for the background
+	std::vector<const void*> Surfaces{};
+	// Distance from the camera to where each pixel's first sample hit, float max for the background
+	std::vector<float> Depth{};
+	// Normal and material color where each pixel's first sample hit, zero for the background
+	std::vector<vec3> Normals{};
+	std::vector<color4> Albedo{};
+
+	// Only reallocates when the size changes
+	void Resize(int NewWidth, int NewHeight)
+	{
+		Width = NewWidth;
+		Height = NewHeight;
+		Pixels.resize(size_t(Width) * Height);
+		Surfaces.resize(size_t(Width) * Height);
+		Depth.resize(size_t(Width) * Height);
+		Normals.resize(size_t(Width) * Height);
+		Albedo.resize(size_t(Width) * Height);
+	}
+
+	color4& At(int x, int y) { return Pixels[size_t(y) * Width + x]; }
+	const color4& At(int x, int y) const { return Pixels[size_t(y) * Width + x]; }
+};
+
+// What rendering a frame took
+struct FrameStats
+{
+	double SamplesPerPixel = 0.0;
+	// Share of pixels that anti-aliasing sampled again
+	double RefinedPixels = 0.0;
+	// Lights shaded per pixel over all of its samples
+	double LightsPerPixel = 0.0;
+	uint32_t MaxPixelLights = 0;
+	// Path tracing only; bounces past the first hit, per camera path
+	double BouncesPerSample = 0.0;
+};
+
+// Which pixels Render traces; the even and odd halves are the squares of a checkerboard, where x + y is even or odd
+enum class PixelSet
+{
+	All,
+	Even,
+	Odd,
+};
+
+namespace Rendering
+{
+	// Renders the image Scene.Camera sees into Frame, resizing it to Drawing::ResX by Drawing::ResY,
+	// with Scene.AntiAliasing and Scene.Region; expects Scene.UpdateAcceleration to have been called
+	// With a region, anti-aliasing stays inside it, and the pixels outside it that aren't traced are interpolated
+	// in place from the ones that are, so the region can move every frame without any buffers of its own
+	// Jitter moves every pixel's first sample by up to half a pixel, so frames blended over time cover the whole pixel
+	// With half of the pixels, the others keep whatever Frame held, and neither anti-aliasing nor the region apply;
+	// see CheckerboardReconstructor
+	FrameStats Render(Scene& Scene, Framebuffer& Frame, vec2 Jitter = vec2(0, 0), PixelSet Pixels = PixelSet::All);
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Random numbers and sample points for anything that jitters or integrates
+// Nothing here keeps shared state: every value is worked out from a key like (seed, pixel, sample, dimension),
+// so results are the same whichever thread or tile order asks for them
+namespace Sampling
+{
+	// Chris Wellons' lowbias32 integer hash
+	constexpr uint32_t Hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	constexpr uint32_t Hash(uint32_t a, uint32_t b)
+	{
+		return Hash(a ^ Hash(b + 0x9e3779b9u));
+	}
+
+	constexpr uint32_t Hash(uint32_t a, uint32_t b, uint32_t c)
+	{
+		return Hash(Hash(a, b), c);
+	}
+
+	// Top 24 bits as a float in [0, 1)
+	constexpr float ToFloat(uint32_t Bits)
+	{
+		return (Bits >> 8) * (1.0f / (1 << 24));
+	}
+
+	// PCG4D from Jarzynski and Olano, "Hash Functions for GPU Rendering"; four well mixed outputs from four inputs
+	constexpr std::array<uint32_t, 4> Pcg4d(uint32_t x, uint32_t y, uint32_t z, uint32_t w)
+	{
+		x = x * 1664525u + 1013904223u;
+		y = y * 1664525u + 1013904223u;
+		z = z * 1664525u + 1013904223u;
+		w = w * 1664525u + 1013904223u;
+		x += y * w; y += z * x; z += x * y; w += y * z;
+		x ^= x >> 16; y ^= y >> 16; z ^= z >> 16; w ^= w >> 16;
+		x += y * w; y += z * x; z += x * y; w += y * z;
+		return { x, y, z, w };
+	}
+
+	// Counter based random numbers: the n-th value of a stream is a hash of its key and n, so streams can be
+	// created anywhere for free and never have to be handed between threads
+	struct Random
+	{
+		uint32_t Seed = 0;
+		uint32_t Pixel = 0;
+		uint32_t Sample = 0;
+		// Counts the values drawn so far
+		uint32_t Dimension = 0;
+
+		constexpr Random(uint32_t Seed, uint32_t Pixel = 0, uint32_t Sample = 0) : Seed(Seed), Pixel(Pixel), Sample(Sample) {}
+
+		constexpr uint32_t NextBits()
+		{
+			return Pcg4d(Pixel, Sample, Dimension++, Seed)[0];
+		}
+
+		// Uniform in [0, 1)
+		constexpr float Next()
+		{
+			return ToFloat(NextBits());
+		}
+	};
+
+	// Sobol directions for the first SOBOL_DIMENSIONS dimensions, from Joe and Kuo's primitive polynomials and
+	// initial direction numbers; dimension 0 is the van der Corput sequence
+	constexpr int SOBOL_DIMENSIONS = 4;
+	constexpr std::array<std::array<uint32_t, 32>, SOBOL_DIMENSIONS> SobolDirections = []
+	{
+		struct Polynomial { uint32_t Degree; uint32_t Coefficients; uint32_t Initial[3]; };
+		constexpr Polynomial Polynomials[SOBOL_DIMENSIONS - 1] = { { 1, 0, { 1 } }, { 2, 1, { 1, 3 } }, { 3, 1, { 1, 3, 1 } } };
+
+		std::array<std::array<uint32_t, 32>, SOBOL_DIMENSIONS> Directions{};
+		for (uint32_t Bit = 0; Bit < 32; Bit++)
+			Directions[0][Bit] = 1u << (31 - Bit);
+		for (int Dimension = 1; Dimension < SOBOL_DIMENSIONS; Dimension++)
+		{
+			const Polynomial& p = Polynomials[Dimension - 1];
+			std::array<uint32_t, 32>& v = Directions[Dimension];
+			for (uint32_t Bit = 0; Bit < 32; Bit++)
+			{
+				if (Bit < p.Degree)
+				{
+					v[Bit] = p.Initial[Bit] << (31 - Bit);
+					continue;
+				}
+				v[Bit] = v[Bit - p.Degree] ^ (v[Bit - p.Degree] >> p.Degree);
+				for (uint32_t k = 1; k < p.Degree; k++)
+				{
+					if ((p.Coefficients >> (p.Degree - 1 - k)) & 1)
+						v[Bit] ^= v[Bit - k];
+				}
+			}
+		}
+		return Directions;
+	}();
+
+	constexpr uint32_t ReverseBits(uint32_t x)
+	{
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	// For every dimension and byte of the index, the XOR of the directions for each value of that byte,
+	// so a point takes four lookups instead of one step per bit; 16 KB
+	// Stored with their bits reversed, the order Owen scrambling works in
+	constexpr std::array<std::array<std::array<uint32_t, 256>, 4>, SOBOL_DIMENSIONS> SobolTables = []
+	{
+		std::array<std::array<std::array<uint32_t, 256>, 4>, SOBOL_DIMENSIONS> Tables{};
+		for (int Dimension = 0; Dimension < SOBOL_DIMENSIONS; Dimension++)
+		{
+			for (int Byte = 0; Byte < 4; Byte++)
+			{
+				for (uint32_t Value = 0; Value < 256; Value++)
+				{
+					uint32_t Result = 0;
+					for (int Bit = 0; Bit < 8; Bit++)
+					{
+						if ((Value >> Bit) & 1)
+							Result ^= SobolDirections[Dimension][Byte * 8 + Bit];
+					}
+					Tables[Dimension][Byte][Value] = ReverseBits(Result);
+				}
+			}
+		}
+		return Tables;
+	}();
+
+	// Index-th point of the Sobol sequence in one of its first SOBOL_DIMENSIONS dimensions, as 32 fixed point bits
+	// in reverse order
+	constexpr uint32_t ReversedSobol(uint32_t Index, int Dimension)
+	{
+		const auto& Table = SobolTables[Dimension];
+		return Table[0][Index & 0xff] ^ Table[1][(Index >> 8) & 0xff] ^ Table[2][(Index >> 16) & 0xff] ^ Table[3][Index >> 24];
+	}
+
+	constexpr uint32_t Sobol(uint32_t Index, int Dimension)
+	{
+		return ReverseBits(ReversedSobol(Index, Dimension));
+	}
+
+	// Laine and Karras' hash of bit reversed values; every bit only depends on the bits below it
+	constexpr uint32_t LaineKarrasPermutation(uint32_t x, uint32_t Seed)
+	{
+		x += Seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	// Owen scrambling from Burley, "Practical Hash-based Owen Scrambling": each bit is flipped depending on the bits
+	// above it, which randomizes the points while keeping the sequence stratified
+	constexpr uint32_t OwenScramble(uint32_t x, uint32_t Seed)
+	{
+		return ReverseBits(LaineKarrasPermutation(ReverseBits(x), Seed));
+	}
+
+	// Owen scrambled Sobol points; sample n of a pixel is the n-th point, so any power of two run of samples is
+	// well stratified. Dimensions past SOBOL_DIMENSIONS are padded with sets of SOBOL_DIMENSIONS that are
+	// shuffled independently of each other, so paths can draw as many dimensions as they need
+	struct SobolSampler
+	{
+		// Different seeds, e.g. one per pixel, give uncorrelated sequences
+		uint32_t Seed = 0;
+		uint32_t Sample = 0;
+		// Next dimension drawn; can be set to skip ahead
+		uint32_t Dimension = 0;
+
+		constexpr SobolSampler(uint32_t Seed, uint32_t Sample) : Seed(Seed), Sample(Sample) {}
+
+		constexpr uint32_t NextBits()
+		{
+			// The shuffled index is shared by the dimensions of a set, so it's only worked out once per set
+			const uint32_t Set = Dimension / SOBOL_DIMENSIONS;
+			if (Set != CachedSet)
+			{
+				CachedSet = Set;
+				SetSeed = Hash(Seed, Set);
+				Index = OwenScramble(Sample, SetSeed);
+			}
+			const uint32_t Within = Dimension % SOBOL_DIMENSIONS;
+			Dimension++;
+			return ReverseBits(LaineKarrasPermutation(ReversedSobol(Index, Within), Hash(SetSeed + Within + 1)));
+		}
+
+		// In [0, 1)
+		constexpr float Next()
+		{
+			return ToFloat(NextBits());
+		}
+
+	private:
+		uint32_t CachedSet = ~0u;
+		uint32_t SetSeed = 0;
+		uint32_t Index = 0;
+	};
+}
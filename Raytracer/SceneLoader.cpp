@@ -0,0 +1,635 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "SceneLoader.hpp"
+
+namespace {
+	// Files are read in chunks of this size, so memory use doesn't depend on the file size
+	constexpr size_t CHUNK_SIZE = 1 << 20;
+
+	// Walks the whitespace separated tokens of a single line
+	struct LineTokenizer
+	{
+		std::string_view Line;
+		size_t Pos = 0;
+
+		explicit LineTokenizer(std::string_view Line) : Line(Line) {}
+
+		void SkipWhitespace()
+		{
+			while (Pos < Line.size() && (Line[Pos] == ' ' || Line[Pos] == '\t' || Line[Pos] == '\r'))
+				Pos++;
+		}
+
+		bool AtEnd()
+		{
+			SkipWhitespace();
+			return Pos >= Line.size() || Line[Pos] == '#';
+		}
+
+		std::string_view NextToken()
+		{
+			if (AtEnd())
+				return {};
+			size_t Start = Pos;
+			while (Pos < Line.size() && Line[Pos] != ' ' && Line[Pos] != '\t' && Line[Pos] != '\r')
+				Pos++;
+			return Line.substr(Start, Pos - Start);
+		}
+
+		bool ReadFloat(float& Out)
+		{
+			if (AtEnd())
+				return false;
+			auto [End, Error] = std::from_chars(Line.data() + Pos, Line.data() + Line.size(), Out);
+			if (Error != std::errc())
+				return false;
+			Pos = End - Line.data();
+			return true;
+		}
+
+		// Whole numbers only, for values like seeds and counts that floats couldn't hold exactly or would truncate
+		template <typename T>
+		bool ReadInteger(T& Out)
+		{
+			if (AtEnd())
+				return false;
+			auto [End, Error] = std::from_chars(Line.data() + Pos, Line.data() + Line.size(), Out);
+			if (Error != std::errc())
+				return false;
+			Pos = End - Line.data();
+			return true;
+		}
+
+		bool ReadUnsigned(uint32_t& Out)
+		{
+			return ReadInteger(Out);
+		}
+
+		bool ReadInt(int& Out)
+		{
+			return ReadInteger(Out);
+		}
+
+		// Reads a count and checks it lies within [Min, Max]
+		bool ReadCount(int& Out, int Min, int Max = std::numeric_limits<int>::max())
+		{
+			uint32_t Value;
+			if (!ReadUnsigned(Value) || Value < static_cast<uint32_t>(Min) || Value > static_cast<uint32_t>(Max))
+				return false;
+			Out = static_cast<int>(Value);
+			return true;
+		}
+
+		bool ReadVec3(vec3& Out)
+		{
+			return ReadFloat(Out.x) && ReadFloat(Out.y) && ReadFloat(Out.z);
+		}
+
+		bool ReadColor(color4& Out)
+		{
+			Out.a = 1.0f;
+			return ReadFloat(Out.r) && ReadFloat(Out.g) && ReadFloat(Out.b);
+		}
+
+		// Reads a color followed by the optional specular and reflective values
+		bool ReadMaterial(Material& Out)
+		{
+			color4 Color;
+			if (!ReadColor(Color))
+				return false;
+
+			float Specular = -1.0f;
+			float Reflective = 0.0f;
+			if (!AtEnd() && !ReadFloat(Specular))
+				return false;
+			if (!AtEnd() && !ReadFloat(Reflective))
+				return false;
+
+			Out = Material(Color, Specular, Reflective);
+			return true;
+		}
+	};
+
+	// State carried from one line of a scene description to the next
+	struct ParseContext
+	{
+		// Files referenced by the scene are looked up relative to this
+		std::filesystem::path BaseDirectory;
+		// Shared meshes by name, as declared by "object" statements
+		std::unordered_map<std::string, uint32_t> Objects{};
+		// Whether an "animation" statement gave the frame count; otherwise it comes from the keyframes
+		bool FrameCountSet = false;
+	};
+
+	// Parses one statement into the scene; blank and comment-only lines are accepted and ignored
+	bool ParseLine(std::string_view Line, ParseContext& Context, Scene& OutScene)
+	{
+		LineTokenizer Tokens(Line);
+		std::string_view Keyword = Tokens.NextToken();
+		if (Keyword.empty())
+			return true;
+
+		if (Keyword == "sphere")
+		{
+			vec3 Origin;
+			float Radius;
+			Material Mat;
+			if (!Tokens.ReadVec3(Origin) || !Tokens.ReadFloat(Radius) || !Tokens.ReadMaterial(Mat))
+				return false;
+
+			Sphere& s = OutScene.Spheres.emplace_back(Origin, Radius);
+			s.Mat = Mat;
+		}
+		else if (Keyword == "plane")
+		{
+			vec3 Point;
+			vec3 Normal;
+			Material Mat;
+			if (!Tokens.ReadVec3(Point) || !Tokens.ReadVec3(Normal) || !Tokens.ReadMaterial(Mat))
+				return false;
+
+			Plane& p = OutScene.Planes.emplace_back(Point, Normal);
+			p.Mat = Mat;
+		}
+		else if (Keyword == "mesh")
+		{
+			std::string_view Path = Tokens.NextToken();
+			TriangleMesh Mesh;
+			if (Path.empty() || !Tokens.ReadMaterial(Mesh.Mat))
+				return false;
+			if (!SceneLoader::LoadObj((Context.BaseDirectory / Path).string(), Mesh))
+				return false;
+
+			OutScene.AddMesh(std::move(Mesh));
+		}
+		else if (Keyword == "object")
+		{
+			std::string_view Name = Tokens.NextToken();
+			std::string_view Path = Tokens.NextToken();
+			TriangleMesh Mesh;
+			if (Name.empty() || Path.empty() || !Tokens.ReadMaterial(Mesh.Mat))
+				return false;
+			if (!SceneLoader::LoadObj((Context.BaseDirectory / Path).string(), Mesh))
+				return false;
+
+			Context.Objects[std::string(Name)] = OutScene.AddSharedMesh(std::move(Mesh));
+		}
+		else if (Keyword == "instance")
+		{
+			auto Object = Context.Objects.find(std::string(Tokens.NextToken()));
+			vec3 Position;
+			vec3 Rotation;
+			float Scale;
+			if (Object == Context.Objects.end() || !Tokens.ReadVec3(Position) || !Tokens.ReadVec3(Rotation) || !Tokens.ReadFloat(Scale))
+				return false;
+
+			std::optional<Material> MaterialOverride;
+			if (!Tokens.AtEnd() && !Tokens.ReadMaterial(MaterialOverride.emplace()))
+				return false;
+
+			OutScene.AddInstance(Object->second, Transform::Place(Position, Rotation, Scale), MaterialOverride);
+		}
+		else if (Keyword == "point" || Keyword == "directional")
+		{
+			float Intensity;
+			vec3 Vector;
+			if (!Tokens.ReadFloat(Intensity) || !Tokens.ReadVec3(Vector))
+				return false;
+
+			if (Keyword == "point")
+			{
+				bool Falloff = false;
+				if (!Tokens.AtEnd())
+				{
+					if (Tokens.NextToken() != "falloff")
+						return false;
+					Falloff = true;
+				}
+				OutScene.AddPointLight(Intensity, Vector, Falloff);
+			}
+			else
+			{
+				OutScene.AddDirectionalLight(Intensity, Vector);
+			}
+		}
+		else if (Keyword == "ambient")
+		{
+			float Intensity;
+			if (!Tokens.ReadFloat(Intensity))
+				return false;
+			OutScene.AddAmbientLight(Intensity);
+		}
+		else if (Keyword == "background")
+		{
+			if (!Tokens.ReadColor(OutScene.BackgroundColor))
+				return false;
+		}
+		else if (Keyword == "lightsamples")
+		{
+			int Samples;
+			if (!Tokens.ReadCount(Samples, 0))
+				return false;
+			OutScene.LightSamples = Samples;
+		}
+		else if (Keyword == "lightcutoff")
+		{
+			float Cutoff;
+			if (!Tokens.ReadFloat(Cutoff) || Cutoff <= 0)
+				return false;
+			OutScene.LightCutoff = Cutoff;
+		}
+		else if (Keyword == "antialiasing")
+		{
+			int Samples;
+			float Threshold = OutScene.AntiAliasing.ContrastThreshold;
+			if (!Tokens.ReadCount(Samples, 0))
+				return false;
+			// A negative threshold would make every pixel an edge
+			if (!Tokens.AtEnd() && (!Tokens.ReadFloat(Threshold) || Threshold < 0))
+				return false;
+			OutScene.AntiAliasing.EdgeSamples = Samples;
+			OutScene.AntiAliasing.ContrastThreshold = Threshold;
+		}
+		else if (Keyword == "region")
+		{
+			RegionSettings& Region = OutScene.Region;
+			int Stride = Region.Stride;
+			int Depth = Region.OutsideDepth;
+			if (!Tokens.AtEnd() && !Tokens.ReadCount(Stride, 1))
+				return false;
+			if (!Tokens.AtEnd() && !Tokens.ReadCount(Depth, 0, Raytracer::MAX_RECURSION_DEPTH))
+				return false;
+			if (!Tokens.AtEnd())
+			{
+				int Left, Top, Width, Height;
+				if (!Tokens.ReadInt(Left) || !Tokens.ReadInt(Top) || !Tokens.ReadCount(Width, 1) || !Tokens.ReadCount(Height, 1))
+					return false;
+				Region.Left = Left;
+				Region.Top = Top;
+				Region.Width = Width;
+				Region.Height = Height;
+				Region.FollowMouse = false;
+			}
+			Region.Enabled = true;
+			Region.Stride = Stride;
+			Region.OutsideDepth = Depth;
+		}
+		else if (Keyword == "temporal")
+		{
+			int MaxHistory = OutScene.Temporal.MaxHistory;
+			if (!Tokens.AtEnd() && !Tokens.ReadCount(MaxHistory, 1))
+				return false;
+			OutScene.Temporal.Enabled = true;
+			OutScene.Temporal.MaxHistory = std::min(MaxHistory, TemporalSettings::HISTORY_LIMIT);
+		}
+		else if (Keyword == "checkerboard")
+		{
+			OutScene.Checkerboard.Enabled = true;
+		}
+		else if (Keyword == "denoise")
+		{
+			int Iterations = OutScene.Denoise.Iterations;
+			if (!Tokens.AtEnd() && !Tokens.ReadCount(Iterations, 1, DenoiseSettings::MAX_ITERATIONS))
+				return false;
+			OutScene.Denoise.Enabled = true;
+			OutScene.Denoise.Iterations = Iterations;
+		}
+		else if (Keyword == "specular")
+		{
+			std::string_view Mode = Tokens.NextToken();
+			if (Mode == "fast")
+				OutScene.FastSpecular = true;
+			else if (Mode == "exact")
+				OutScene.FastSpecular = false;
+			else
+				return false;
+		}
+		else if (Keyword == "shadowcache")
+		{
+			float CellSize = OutScene.Shadows.CellSize;
+			if (!Tokens.AtEnd() && (!Tokens.ReadFloat(CellSize) || CellSize <= 0))
+				return false;
+			OutScene.CacheShadows = true;
+			OutScene.Shadows.CellSize = CellSize;
+		}
+		else if (Keyword == "integrator")
+		{
+			std::string_view Type = Tokens.NextToken();
+			if (Type == "whitted")
+				OutScene.PathTracing.Enabled = false;
+			else if (Type == "path")
+				OutScene.PathTracing.Enabled = true;
+			else
+				return false;
+			uint32_t Seed = OutScene.PathTracing.Seed;
+			if (!Tokens.AtEnd() && !Tokens.ReadUnsigned(Seed))
+				return false;
+			OutScene.PathTracing.Seed = Seed;
+		}
+		else if (Keyword == "accelerator")
+		{
+			std::string_view Type = Tokens.NextToken();
+			if (Type == "linear")
+				OutScene.Accelerator = AcceleratorType::Linear;
+			else if (Type == "bvh")
+				OutScene.Accelerator = AcceleratorType::BVH;
+			else if (Type == "grid")
+				OutScene.Accelerator = AcceleratorType::Grid;
+			else
+				return false;
+		}
+		else if (Keyword == "bvh")
+		{
+			std::string_view Quality = Tokens.NextToken();
+			if (Quality == "fast")
+				OutScene.BuildQuality = BVHBuildQuality::Fast;
+			else if (Quality == "high")
+				OutScene.BuildQuality = BVHBuildQuality::High;
+			else
+				return false;
+		}
+		else if (Keyword == "origin")
+		{
+			if (!Tokens.ReadVec3(OutScene.Camera.Position))
+				return false;
+		}
+		else if (Keyword == "animation")
+		{
+			int Frames;
+			float FramesPerSecond = OutScene.Animation.FramesPerSecond;
+			if (!Tokens.ReadCount(Frames, 1))
+				return false;
+			if (!Tokens.AtEnd() && (!Tokens.ReadFloat(FramesPerSecond) || !(FramesPerSecond > 0) || !std::isfinite(FramesPerSecond)))
+				return false;
+			OutScene.Animation.FrameCount = Frames;
+			OutScene.Animation.FramesPerSecond = FramesPerSecond;
+			Context.FrameCountSet = true;
+		}
+		else if (Keyword == "keyframe")
+		{
+			float Time;
+			std::string_view Target = Tokens.NextToken();
+			if (!Tokens.ReadFloat(Time) || !(Time >= 0) || !std::isfinite(Time))
+				return false;
+
+			// Keyframes belong to the object declared last, so they follow it in the file
+			Animation& Anim = OutScene.Animation;
+			auto KeysFor = [](auto& List, size_t Count) -> auto&
+			{
+				const uint32_t Index = static_cast<uint32_t>(Count - 1);
+				if (List.empty() || List.back().Index != Index)
+					List.emplace_back().Index = Index;
+				return List.back();
+			};
+			if (Target == "camera")
+			{
+				vec3 Position;
+				float Yaw, Pitch;
+				float FieldOfView = OutScene.Camera.FieldOfView;
+				if (!Tokens.ReadVec3(Position) || !Tokens.ReadFloat(Yaw) || !Tokens.ReadFloat(Pitch))
+					return false;
+				if (!Tokens.AtEnd() && (!Tokens.ReadFloat(FieldOfView) || FieldOfView <= 0 || FieldOfView >= 180))
+					return false;
+				Anim.Camera.Position.Add(Time, Position);
+				Anim.Camera.Yaw.Add(Time, Yaw);
+				Anim.Camera.Pitch.Add(Time, Pitch);
+				Anim.Camera.FieldOfView.Add(Time, FieldOfView);
+			}
+			else if (Target == "sphere")
+			{
+				vec3 Origin;
+				float Radius;
+				if (OutScene.Spheres.empty() || !Tokens.ReadVec3(Origin) || !Tokens.ReadFloat(Radius))
+					return false;
+				SphereAnimation& Keys = KeysFor(Anim.Spheres, OutScene.Spheres.size());
+				Keys.Origin.Add(Time, Origin);
+				Keys.Radius.Add(Time, Radius);
+			}
+			else if (Target == "light")
+			{
+				float Intensity;
+				if (OutScene.Lights.empty() || !Tokens.ReadFloat(Intensity))
+					return false;
+				LightAnimation& Keys = KeysFor(Anim.Lights, OutScene.Lights.size());
+				Keys.Intensity.Add(Time, Intensity);
+				if (OutScene.Lights.back().Type != LightType::Ambient)
+				{
+					vec3 Vector;
+					if (!Tokens.ReadVec3(Vector))
+						return false;
+					Keys.Vector.Add(Time, Vector);
+				}
+			}
+			else if (Target == "instance")
+			{
+				vec3 Position;
+				vec3 Rotation;
+				float Scale;
+				if (OutScene.Instances.empty() || !Tokens.ReadVec3(Position) || !Tokens.ReadVec3(Rotation) || !Tokens.ReadFloat(Scale))
+					return false;
+				InstanceAnimation& Keys = KeysFor(Anim.Instances, OutScene.Instances.size());
+				Keys.Position.Add(Time, Position);
+				Keys.Rotation.Add(Time, Rotation);
+				Keys.Scale.Add(Time, Scale);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		else if (Keyword == "camera")
+		{
+			Camera& View = OutScene.Camera;
+			if (!Tokens.ReadVec3(View.Position) || !Tokens.ReadFloat(View.Yaw) || !Tokens.ReadFloat(View.Pitch))
+				return false;
+			if (!Tokens.AtEnd() && (!Tokens.ReadFloat(View.FieldOfView) || View.FieldOfView <= 0 || View.FieldOfView >= 180))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+
+		// Anything left over other than a comment is an error
+		return Tokens.AtEnd();
+	}
+
+	// Parses one OBJ statement into the mesh; unsupported statements are skipped
+	bool ParseObjLine(std::string_view Line, TriangleMesh& OutMesh)
+	{
+		LineTokenizer Tokens(Line);
+		std::string_view Keyword = Tokens.NextToken();
+
+		if (Keyword == "v")
+		{
+			vec3 Vertex;
+			if (!Tokens.ReadVec3(Vertex))
+				return false;
+			OutMesh.Vertices.push_back(Vertex);
+		}
+		else if (Keyword == "f")
+		{
+			// Each vertex is "v", "v/vt", "v//vn" or "v/vt/vn"; only the position index matters
+			// Negative indices count back from the most recent vertex
+			uint32_t First = 0;
+			uint32_t Previous = 0;
+			int Count = 0;
+			for (std::string_view Token = Tokens.NextToken(); !Token.empty(); Token = Tokens.NextToken())
+			{
+				long long Index = 0;
+				auto [End, Error] = std::from_chars(Token.data(), Token.data() + Token.size(), Index);
+				if (Error != std::errc() || Index == 0)
+					return false;
+
+				Index = Index > 0 ? Index - 1 : static_cast<long long>(OutMesh.Vertices.size()) + Index;
+				if (Index < 0 || Index >= static_cast<long long>(OutMesh.Vertices.size()))
+					return false;
+
+				uint32_t Current = static_cast<uint32_t>(Index);
+				if (Count == 0)
+					First = Current;
+				else if (Count >= 2)
+					OutMesh.Indices.insert(OutMesh.Indices.end(), { First, Previous, Current });
+				Previous = Current;
+				Count++;
+			}
+			if (Count < 3)
+				return false;
+		}
+		return true;
+	}
+
+	// Without an "animation" statement, keyframed scenes play until their last keyframe
+	void FinishScene(const ParseContext& Context, Scene& OutScene)
+	{
+		Animation& Anim = OutScene.Animation;
+		if (Context.FrameCountSet || Anim.Empty())
+			return;
+		const double LastFrame = std::floor(static_cast<double>(Anim.EndTime()) * Anim.FramesPerSecond);
+		Anim.FrameCount = static_cast<int>(std::min(LastFrame + 1.0, static_cast<double>(std::numeric_limits<int>::max())));
+	}
+
+	void ReportError(std::string_view Source, size_t LineNumber, std::string_view Line)
+	{
+		std::cerr << "Parse error in " << Source << " on line " << LineNumber << ": " << Line << std::endl;
+	}
+
+	// Streams File in fixed-size chunks and hands each complete line to Callback
+	// Stops early and returns false as soon as Callback does
+	template <typename Fn>
+	bool ForEachLine(std::ifstream& File, Fn&& Callback)
+	{
+		std::vector<char> Buffer(CHUNK_SIZE);
+		size_t Carry = 0;
+		while (true)
+		{
+			File.read(Buffer.data() + Carry, Buffer.size() - Carry);
+			const size_t Filled = Carry + static_cast<size_t>(File.gcount());
+			const bool AtEnd = !File;
+
+			size_t LineStart = 0;
+			while (const char* NewLine = static_cast<const char*>(std::memchr(Buffer.data() + LineStart, '\n', Filled - LineStart)))
+			{
+				const size_t LineEnd = NewLine - Buffer.data();
+				if (!Callback(std::string_view(Buffer.data() + LineStart, LineEnd - LineStart)))
+					return false;
+				LineStart = LineEnd + 1;
+			}
+
+			// Whatever is left is the start of a line that continues in the next chunk
+			Carry = Filled - LineStart;
+			if (AtEnd)
+				return Carry == 0 || Callback(std::string_view(Buffer.data() + LineStart, Carry));
+
+			std::memmove(Buffer.data(), Buffer.data() + LineStart, Carry);
+			if (Carry == Buffer.size())
+				Buffer.resize(Buffer.size() * 2);
+		}
+	}
+}
+
+namespace SceneLoader
+{
+	bool LoadScene(const std::string& Path, Scene& OutScene)
+	{
+		std::ifstream File(Path, std::ios::binary);
+		if (!File)
+		{
+			std::cerr << "Failed to open scene file: " << Path << std::endl;
+			return false;
+		}
+
+		ParseContext Context{ std::filesystem::path(Path).parent_path() };
+		size_t LineNumber = 0;
+		const bool Parsed = ForEachLine(File, [&](std::string_view Line)
+		{
+			LineNumber++;
+			if (ParseLine(Line, Context, OutScene))
+				return true;
+			ReportError(Path, LineNumber, Line);
+			return false;
+		});
+		if (Parsed)
+			FinishScene(Context, OutScene);
+		return Parsed;
+	}
+
+	bool ParseScene(std::string_view Source, Scene& OutScene)
+	{
+		ParseContext Context{ std::filesystem::current_path() };
+		size_t LineNumber = 0;
+		size_t LineStart = 0;
+		while (LineStart < Source.size())
+		{
+			size_t LineEnd = Source.find('\n', LineStart);
+			if (LineEnd == std::string_view::npos)
+				LineEnd = Source.size();
+
+			LineNumber++;
+			std::string_view Line = Source.substr(LineStart, LineEnd - LineStart);
+			if (!ParseLine(Line, Context, OutScene))
+			{
+				ReportError("<memory>", LineNumber, Line);
+				return false;
+			}
+			LineStart = LineEnd + 1;
+		}
+		FinishScene(Context, OutScene);
+		return true;
+	}
+
+	bool LoadObj(const std::string& Path, TriangleMesh& OutMesh)
+	{
+		std::ifstream File(Path, std::ios::binary);
+		if (!File)
+		{
+			std::cerr << "Failed to open OBJ file: " << Path << std::endl;
+			return false;
+		}
+
+		size_t LineNumber = 0;
+		bool Loaded = ForEachLine(File, [&](std::string_view Line)
+		{
+			LineNumber++;
+			if (ParseObjLine(Line, OutMesh))
+				return true;
+			ReportError(Path, LineNumber, Line);
+			return false;
+		});
+
+		// Growing the buffers may have left a lot of slack on large meshes
+		OutMesh.Vertices.shrink_to_fit();
+		OutMesh.Indices.shrink_to_fit();
+		OutMesh.ComputeBounds();
+		return Loaded;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+#include "Raytracer.hpp"
+
+// Scene description format; one statement per line, '#' starts a comment:
+//   background <r> <g> <b>
+//   origin <x> <y> <z>
+//   camera <x> <y> <z> <yaw> <pitch> [field of view]
+//   sphere <x> <y> <z> <radius> <r> <g> <b> [specular] [reflective]
+//   plane <x> <y> <z> <normal x> <normal y> <normal z> <r> <g> <b> [specular] [reflective]
+//   mesh <obj path> <r> <g> <b> [specular] [reflective]
+//   object <name> <obj path> <r> <g> <b> [specular] [reflective]
+//   instance <object name> <x> <y> <z> <rotation x> <rotation y> <rotation z> <scale> [<r> <g> <b> [specular] [reflective]]
+//   ambient <intensity>
+//   point <intensity> <x> <y> <z> [falloff]
+//   directional <intensity> <x> <y> <z>
+//   lightsamples <count>
+//   antialiasing <edge samples> [contrast threshold]
+//   region [stride] [reflection depth] [<left> <top> <width> <height>]
+//   temporal [max history]
+//   checkerboard
+//   denoise [iterations]
+//   lightcutoff <intensity>
+//   shadowcache [cell size]
+//   specular <fast|exact>
+//   integrator <whitted|path> [seed]
+//   accelerator <linear|bvh|grid>
+//   bvh <fast|high>
+//   animation <frames> [frames per second]
+//   keyframe camera <time> <x> <y> <z> <yaw> <pitch> [field of view]
+//   keyframe sphere <time> <x> <y> <z> <radius>
+//   keyframe light <time> <intensity> [<x> <y> <z>]
+//   keyframe instance <time> <x> <y> <z> <rotation x> <rotation y> <rotation z> <scale>
+// A negative or missing specular exponent means the surface is matte
+// camera angles are in degrees; yaw turns right and pitch up from looking down +z, and the vertical field of view
+// defaults to about 53, which origin keeps
+// Mesh paths are relative to the scene file and can't contain whitespace
+// Point lights marked falloff fade with distance and are skipped where they'd add less than lightcutoff (0.01 by default)
+// antialiasing samples pixels on edges again, with edge samples rounded down to a square; the threshold defaults to 0.1
+// region renders at full quality only inside a rectangle, 128 pixels square around the mouse unless given, and traces
+// every stride-th pixel (4 by default) with reflection depth bounces (1 by default, 3 at most) elsewhere; R toggles it
+// while running
+// temporal blends each frame in the viewer with the ones before it, over up to 64 frames by default and 65535 at most
+// checkerboard has the viewer trace half the pixels each frame and fill in the others; C toggles it while running
+// denoise smooths away the noise of low sample renders, e.g. early path tracing passes, in 3 filter passes by default and 10 at most
+// specular picks between an approximate pow for specular highlights, the default, and std::pow
+// integrator path renders progressively with a path tracer instead of Whitted style ray tracing; the seed defaults to 1
+// shadowcache reuses shadow ray results between frames, shared by every point in a cell (0.05 wide by default)
+// Counts, like lightsamples, antialiasing edge samples and animation frames, are whole numbers
+// With lightsamples, each shading point samples that many point lights instead of evaluating all of them
+// Objects are only visible through instances, which share their geometry; rotations are in degrees
+// animation sets how many frames --render draws by default, at 24 frames per second unless given; without it, the
+// animation runs until the last keyframe
+// keyframe moves the sphere, light or instance declared last, or the camera, to where it is at a time in seconds, taking
+// the values its own statement does; in between keyframes it moves in a straight line. Lights other than ambient ones
+// take a position or direction
+namespace SceneLoader
+{
+	// Streams a scene file into OutScene in a single pass, appending to whatever it already holds
+	// Returns false and reports the offending line if the file can't be read or is malformed
+	bool LoadScene(const std::string& Path, Scene& OutScene);
+
+	// Same as LoadScene, but parses a description that is already in memory
+	bool ParseScene(std::string_view Source, Scene& OutScene);
+
+	// Streams the vertices and faces of a Wavefront OBJ file into OutMesh
+	// Polygons are fan-triangulated; normals, texture coordinates, groups and materials are ignored
+	bool LoadObj(const std::string& Path, TriangleMesh& OutMesh);
+}
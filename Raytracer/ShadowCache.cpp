@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "Raytracer.hpp"
+#include "ShadowCache.hpp"
+
+namespace {
+	// splitmix64's finalizer; folds Value into Hash
+	uint64_t Mix(uint64_t Hash, uint64_t Value)
+	{
+		Hash ^= Value + 0x9e3779b97f4a7c15ull;
+		Hash = (Hash ^ (Hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+		Hash = (Hash ^ (Hash >> 27)) * 0x94d049bb133111ebull;
+		return Hash ^ (Hash >> 31);
+	}
+
+	// Each thread counts into the shard its first count picked, so up to ShadowCache::STATS_SHARDS threads never share one
+	size_t ThreadShard()
+	{
+		static std::atomic<size_t> NextShard{ 0 };
+		thread_local const size_t Shard = NextShard.fetch_add(1, std::memory_order_relaxed) % ShadowCache::STATS_SHARDS;
+		return Shard;
+	}
+
+	void Add(uint64_t& Counter, uint64_t Value)
+	{
+		if (Value > 0)
+			std::atomic_ref<uint64_t>(Counter).fetch_add(Value, std::memory_order_relaxed);
+	}
+
+	bool Overlaps(const AABB& a, const AABB& b)
+	{
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			if (a.Max[Axis] < b.Min[Axis] || b.Max[Axis] < a.Min[Axis])
+				return false;
+		}
+		return true;
+	}
+}
+
+void ShadowCache::Update(const LightSet& Lights, const std::vector<AABB>& ObjectBounds, const std::vector<AABB>& Reshaped)
+{
+	Shards.assign(STATS_SHARDS, StatsShard());
+
+	std::vector<vec3> CurrentLights;
+	CurrentLights.reserve(Lights.PointX.size() + Lights.DirectionalX.size());
+	for (size_t i = 0; i < Lights.PointX.size(); i++)
+		CurrentLights.emplace_back(Lights.PointX[i], Lights.PointY[i], Lights.PointZ[i]);
+	for (size_t i = 0; i < Lights.DirectionalX.size(); i++)
+		CurrentLights.emplace_back(Lights.DirectionalX[i], Lights.DirectionalY[i], Lights.DirectionalZ[i]);
+
+	// Added or removed lights and objects shift the ids of everything after them, so start over
+	const bool Reset = Entries.empty()
+		|| CurrentLights.size() != PreviousLights.size() || Lights.PointX.size() != PreviousPointLights
+		|| ObjectBounds.size() != PreviousBounds.size();
+	if (Reset)
+	{
+		Regions = AABB();
+		for (const AABB& Bounds : ObjectBounds)
+			Regions.Grow(Bounds);
+		if (ObjectBounds.empty())
+			Regions = AABB(vec3(0, 0, 0), vec3(1, 1, 1));
+		for (int Axis = 0; Axis < 3; Axis++)
+			RegionSize[Axis] = std::max((Regions.Max[Axis] - Regions.Min[Axis]) / REGION_RESOLUTION, 1e-6f);
+		LightGenerations.assign(CurrentLights.size(), 0);
+		Clear();
+	}
+	else
+	{
+		for (uint32_t Light = 0; Light < CurrentLights.size(); Light++)
+		{
+			if (CurrentLights[Light] != PreviousLights[Light])
+				InvalidateLight(Light);
+		}
+		for (size_t i = 0; i < ObjectBounds.size(); i++)
+		{
+			if (ObjectBounds[i].Min != PreviousBounds[i].Min || ObjectBounds[i].Max != PreviousBounds[i].Max)
+			{
+				AABB Changed = ObjectBounds[i];
+				Changed.Grow(PreviousBounds[i]);
+				InvalidateBounds(Lights, Changed);
+			}
+		}
+		for (const AABB& Bounds : Reshaped)
+			InvalidateBounds(Lights, Bounds);
+	}
+
+	PreviousLights = std::move(CurrentLights);
+	PreviousPointLights = Lights.PointX.size();
+	PreviousBounds = ObjectBounds;
+}
+
+void ShadowCache::Clear()
+{
+	Entries.assign(size_t(1) << TABLE_BITS, 0);
+	RegionGenerations.assign(REGION_RESOLUTION * REGION_RESOLUTION * REGION_RESOLUTION, 0);
+}
+
+ShadowCache::PointKey ShadowCache::Key(const vec3& Point, const vec3& Normal) const
+{
+	// Surfaces facing different ways within a cell, like the two sides of a thin wall, are kept apart
+	const float x = std::abs(Normal.x);
+	const float y = std::abs(Normal.y);
+	const float z = std::abs(Normal.z);
+	const int Axis = x > y ? (x > z ? 0 : 2) : (y > z ? 1 : 2);
+	const uint64_t Facing = Axis * 2 + (Normal[Axis] < 0.0f ? 1 : 0);
+
+	PointKey Key;
+	if (RegionGenerations.empty())
+		return Key;
+	Key.Hash = Facing;
+	int Region[3];
+	for (int i = 0; i < 3; i++)
+	{
+		Key.Hash = Mix(Key.Hash, static_cast<uint64_t>(static_cast<int64_t>(std::floor(Point[i] / CellSize))));
+		Region[i] = static_cast<int>(std::clamp((Point[i] - Regions.Min[i]) / RegionSize[i], 0.0f, REGION_RESOLUTION - 1.0f));
+	}
+	Key.Hash = Mix(Key.Hash, RegionGenerations[Region[0] + REGION_RESOLUTION * (Region[1] + REGION_RESOLUTION * Region[2])]);
+	Key.First = Key.Hash >> (64 - TABLE_BITS);
+	return Key;
+}
+
+bool ShadowCache::Lookup(const PointKey& Point, uint32_t Light, bool& Visible) const
+{
+	if (Entries.empty() || Light >= LightGenerations.size())
+		return false;
+	const uint64_t Hash = Mix(Mix(Point.Hash, Light), LightGenerations[Light]) | 2;
+	uint64_t& Slot = Entries[(Point.First + Light) & (Entries.size() - 1)];
+	const uint64_t Entry = std::atomic_ref<uint64_t>(Slot).load(std::memory_order_relaxed);
+	if ((Entry & ~uint64_t(1)) != (Hash & ~uint64_t(1)))
+		return false;
+	Visible = (Entry & 1) != 0;
+	return true;
+}
+
+void ShadowCache::Store(const PointKey& Point, uint32_t Light, bool Visible) const
+{
+	if (Entries.empty() || Light >= LightGenerations.size())
+		return;
+	const uint64_t Hash = Mix(Mix(Point.Hash, Light), LightGenerations[Light]) | 2;
+	uint64_t& Slot = Entries[(Point.First + Light) & (Entries.size() - 1)];
+	std::atomic_ref<uint64_t>(Slot).store((Hash & ~uint64_t(1)) | (Visible ? 1 : 0), std::memory_order_relaxed);
+}
+
+void ShadowCache::Count(const ShadowCacheStats& Counts) const
+{
+	StatsShard& Shard = Shards[ThreadShard()];
+	Add(Shard.Lookups, Counts.Lookups);
+	Add(Shard.Hits, Counts.Hits);
+	Add(Shard.Verified, Counts.Verified);
+	Add(Shard.Mismatches, Counts.Mismatches);
+}
+
+ShadowCacheStats ShadowCache::Stats() const
+{
+	ShadowCacheStats Totals;
+	for (StatsShard& Shard : Shards)
+	{
+		Totals.Lookups += std::atomic_ref<uint64_t>(Shard.Lookups).load(std::memory_order_relaxed);
+		Totals.Hits += std::atomic_ref<uint64_t>(Shard.Hits).load(std::memory_order_relaxed);
+		Totals.Verified += std::atomic_ref<uint64_t>(Shard.Verified).load(std::memory_order_relaxed);
+		Totals.Mismatches += std::atomic_ref<uint64_t>(Shard.Mismatches).load(std::memory_order_relaxed);
+	}
+	return Totals;
+}
+
+void ShadowCache::InvalidateLight(uint32_t Light)
+{
+	LightGenerations[Light]++;
+}
+
+void ShadowCache::InvalidateBounds(const LightSet& Lights, const AABB& Changed)
+{
+	constexpr float Infinity = std::numeric_limits<float>::infinity();
+	for (int z = 0; z < REGION_RESOLUTION; z++)
+	{
+		for (int y = 0; y < REGION_RESOLUTION; y++)
+		{
+			for (int x = 0; x < REGION_RESOLUTION; x++)
+			{
+				// Conservative: a shadow ray from the region stays inside the box around the region and its light,
+				// or for directional lights, inside the region swept towards the light
+				const AABB Region = RegionBounds(x, y, z);
+				bool Affected = Overlaps(Region, Changed);
+				for (size_t i = 0; i < Lights.PointX.size() && !Affected; i++)
+				{
+					AABB Reach = Region;
+					Reach.Grow(vec3(Lights.PointX[i], Lights.PointY[i], Lights.PointZ[i]));
+					Affected = Overlaps(Reach, Changed);
+				}
+				for (size_t i = 0; i < Lights.DirectionalX.size() && !Affected; i++)
+				{
+					AABB Reach = Region;
+					const float Direction[3] = { Lights.DirectionalX[i], Lights.DirectionalY[i], Lights.DirectionalZ[i] };
+					for (int Axis = 0; Axis < 3; Axis++)
+					{
+						if (Direction[Axis] > 0.0f)
+							Reach.Max[Axis] = Infinity;
+						else if (Direction[Axis] < 0.0f)
+							Reach.Min[Axis] = -Infinity;
+					}
+					Affected = Overlaps(Reach, Changed);
+				}
+				if (Affected)
+					RegionGenerations[x + REGION_RESOLUTION * (y + REGION_RESOLUTION * z)]++;
+			}
+		}
+	}
+}
+
+AABB ShadowCache::RegionBounds(int x, int y, int z) const
+{
+	constexpr float Infinity = std::numeric_limits<float>::infinity();
+	const int Cell[3] = { x, y, z };
+	AABB Bounds;
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		Bounds.Min[Axis] = Cell[Axis] == 0 ? -Infinity : Regions.Min[Axis] + Cell[Axis] * RegionSize[Axis];
+		Bounds.Max[Axis] = Cell[Axis] == REGION_RESOLUTION - 1 ? Infinity : Regions.Min[Axis] + (Cell[Axis] + 1) * RegionSize[Axis];
+	}
+	return Bounds;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "BVH.hpp"
+#include "VecUtils.hpp"
+
+struct LightSet;
+
+// Hit counts since the last ShadowCache::Update
+struct ShadowCacheStats
+{
+	uint64_t Lookups = 0;
+	uint64_t Hits = 0;
+	// Hits that were traced anyway because ShadowCache::Verify is set, and how many of them the cache got wrong
+	uint64_t Verified = 0;
+	uint64_t Mismatches = 0;
+};
+
+// Remembers whether shadow rays reached their light between frames, so a moving camera only traces shadow rays
+// for surfaces it hasn't seen before; a hashed grid keyed by the shading point's cell, which way the surface
+// faces and the light
+// Everything sharing a cell shares its visibility, so shadow edges are only as sharp as CellSize
+// Entries are never removed; they stop matching when their light or the region around them is invalidated
+// Key, Lookup, Store and Count can be called from several threads at once, but not alongside Update or Clear;
+// entries are read and written whole with relaxed atomics, so a racing Store at worst replaces another
+class ShadowCache
+{
+public:
+	// Where a shading point lands in the cache; worked out once and then looked up for every light
+	// A point's lights sit in consecutive entries starting at First, so they share cache lines
+	struct PointKey
+	{
+		uint64_t Hash = 0;
+		size_t First = 0;
+	};
+
+	// Light ids are point light indices, followed by the directional lights, as in LightSet
+	// Diffs the lights and object bounds against the previous call and invalidates whatever the changes can affect:
+	// a moved light loses all of its entries, a moved object the regions whose shadow rays could pass through it
+	// Reshaped lists objects that changed without their bounds changing, like refitted meshes
+	// Planes aren't tracked; call Clear after changing them
+	void Update(const LightSet& Lights, const std::vector<AABB>& ObjectBounds, const std::vector<AABB>& Reshaped);
+
+	// Forgets everything
+	void Clear();
+
+	// Forgets everything and frees the table; the next Update starts from scratch
+	void Release()
+	{
+		Entries = std::vector<uint64_t>();
+		RegionGenerations = std::vector<uint32_t>();
+	}
+
+	// Before the first Update, and after Release, nothing is found and nothing is stored
+	bool Empty() const { return Entries.empty(); }
+
+	PointKey Key(const vec3& Point, const vec3& Normal) const;
+
+	// Returns whether the cache knows if the light is visible from the point, and if so, sets Visible
+	// Lights added since the last Update are never found
+	bool Lookup(const PointKey& Point, uint32_t Light, bool& Visible) const;
+	void Store(const PointKey& Point, uint32_t Light, bool Visible) const;
+
+	// Adds to the hit counts; callers count lookups locally and add them here once in a while, rather than every
+	// thread updating shared counters for every lookup
+	void Count(const ShadowCacheStats& Counts) const;
+	ShadowCacheStats Stats() const;
+
+	size_t MemoryUsage() const { return Entries.size() * sizeof(uint64_t) + (LightGenerations.size() + RegionGenerations.size()) * sizeof(uint32_t); }
+
+	// Side of the cubic cells shading points are grouped into
+	float CellSize = 0.05f;
+	// Traces every hit anyway to count how often the cache is wrong; only for measuring
+	bool Verify = false;
+
+	// The table has 2^TABLE_BITS entries of 8 bytes; colliding entries replace each other
+	static constexpr int TABLE_BITS = 20;
+	// Invalidation is tracked per region, on a grid of this many regions a side over the scene's objects
+	static constexpr int REGION_RESOLUTION = 16;
+	// Threads add their counts to one of this many sets of counters, each on a cache line of its own
+	static constexpr size_t STATS_SHARDS = 16;
+
+private:
+	void InvalidateLight(uint32_t Light);
+	// Invalidates the regions with a point whose shadow ray to some light could pass through Changed
+	void InvalidateBounds(const LightSet& Lights, const AABB& Changed);
+	// Bounds of a region, stretched out to infinity on the outer faces since points past the grid are clamped into it
+	AABB RegionBounds(int x, int y, int z) const;
+
+	struct alignas(64) StatsShard
+	{
+		uint64_t Lookups = 0;
+		uint64_t Hits = 0;
+		uint64_t Verified = 0;
+		uint64_t Mismatches = 0;
+	};
+
+	// Each entry is a hash of its key with the lowest bit replaced by the visibility; 0 is empty
+	// Only ever accessed through std::atomic_ref, which is why Lookup and Store can be const
+	mutable std::vector<uint64_t> Entries{};
+	std::vector<uint32_t> LightGenerations{};
+	std::vector<uint32_t> RegionGenerations{};
+	AABB Regions{};
+	vec3 RegionSize = vec3(1, 1, 1);
+
+	// What the previous Update saw
+	std::vector<vec3> PreviousLights{};
+	size_t PreviousPointLights = 0;
+	std::vector<AABB> PreviousBounds{};
+
+	mutable std::vector<StatsShard> Shards = std::vector<StatsShard>(STATS_SHARDS);
+};
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Parallel.hpp"
+#include "Sampling.hpp"
+#include "Temporal.hpp"
+
+namespace {
+	constexpr float BACKGROUND = std::numeric_limits<float>::max();
+
+	// Keeps history within the colors around the pixel this frame, which is what ghosts and stale shading miss
+	// The range is the neighbours' mean give or take Spread standard deviations, which is tighter than their
+	// minimum and maximum where a few of them stand out (Salvi, "An Excursion in Temporal Supersampling")
+	color4 ClampToNeighbours(const Framebuffer& Frame, int x, int y, const color4& Color, float Spread)
+	{
+		float Sum[3] = {};
+		float SquaredSum[3] = {};
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				const int nx = std::clamp(x + dx, 0, Frame.Width - 1);
+				const int ny = std::clamp(y + dy, 0, Frame.Height - 1);
+				const color4& Neighbour = Frame.At(nx, ny);
+				for (int Channel = 0; Channel < 3; Channel++)
+				{
+					Sum[Channel] += Neighbour[Channel];
+					SquaredSum[Channel] += Neighbour[Channel] * Neighbour[Channel];
+				}
+			}
+		}
+		color4 Result = Color;
+		for (int Channel = 0; Channel < 3; Channel++)
+		{
+			const float Mean = Sum[Channel] / 9.0f;
+			const float Deviation = std::sqrt(std::max(SquaredSum[Channel] / 9.0f - Mean * Mean, 0.0f));
+			Result[Channel] = std::clamp(Color[Channel], Mean - Spread * Deviation, Mean + Spread * Deviation);
+		}
+		return Result;
+	}
+}
+
+vec2 TemporalAccumulator::NextJitter() const
+{
+	Sampling::SobolSampler Sampler(0, FrameIndex);
+	const float x = Sampler.Next() - 0.5f;
+	const float y = Sampler.Next() - 0.5f;
+	return vec2(x, y);
+}
+
+TemporalStats TemporalAccumulator::Accumulate(const TemporalSettings& Settings, const Camera& View, vec2 Jitter, Framebuffer& Frame)
+{
+	const size_t PixelCount = Frame.Pixels.size();
+	if (History.size() != PixelCount)
+	{
+		History = Frame.Pixels;
+		HistoryDepth = Frame.Depth;
+		HistoryLength.assign(PixelCount, 1);
+		Blended.resize(PixelCount);
+		BlendedLength.resize(PixelCount);
+		PreviousView = View;
+		FrameIndex = 1;
+		return TemporalStats{ 0.0, 1.0 };
+	}
+
+	const bool Moved = View != PreviousView;
+	const int MaxLength = std::clamp(Moved ? std::min(Settings.MotionHistory, Settings.MaxHistory) : Settings.MaxHistory, 1, TemporalSettings::HISTORY_LIMIT);
+	const int Width = Frame.Width;
+	const int Height = Frame.Height;
+
+	// Whether history stored at StoredDepth belongs to the surface found at Expected
+	auto DepthMatches = [&](float StoredDepth, float Expected)
+	{
+		if (StoredDepth == BACKGROUND || Expected == BACKGROUND)
+			return StoredDepth == Expected;
+		return std::abs(StoredDepth - Expected) <= Settings.DepthTolerance * Expected;
+	};
+
+	// On silhouettes the history mixes both sides, and its depth is whichever side its last sample hit,
+	// so it is only kept in check by the neighbour clamp
+	auto OnSilhouette = [&](int x, int y, float Depth)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				const float Neighbour = Frame.Depth[size_t(std::clamp(y + dy, 0, Height - 1)) * Width + std::clamp(x + dx, 0, Width - 1)];
+				if (!DepthMatches(Neighbour, Depth))
+					return true;
+			}
+		}
+		return false;
+	};
+
+	// History at the point pixel (x, y) sees now, filtered from the history pixels around where that point was on screen
+	// last frame; taps whose depth doesn't match the point are left out. Returns false if too few match
+	auto Reproject = [&](int x, int y, color4& Color, int& Length)
+	{
+		const size_t i = size_t(y) * Width + x;
+		const float Depth = Frame.Depth[i];
+		if (!Moved)
+		{
+			// Objects can move while the camera stays still, uncovering surfaces the history never saw
+			Color = History[i];
+			Length = HistoryLength[i];
+			return DepthMatches(HistoryDepth[i], Depth) || OnSilhouette(x, y, Depth);
+		}
+
+		// The background is infinitely far away, so only turning the camera moves it; it takes the nearest pixel
+		vec2 PreviousPos;
+		if (Depth == BACKGROUND)
+		{
+			if (!PreviousView.ProjectDirection(View.PixelDirection(static_cast<float>(x), static_cast<float>(y)), PreviousPos))
+				return false;
+			const int hx = static_cast<int>(std::floor(PreviousPos.x + 0.5f));
+			const int hy = static_cast<int>(std::floor(PreviousPos.y + 0.5f));
+			if (hx < 0 || hy < 0 || hx >= Width || hy >= Height)
+				return false;
+			const size_t Previous = size_t(hy) * Width + hx;
+			Color = History[Previous];
+			Length = HistoryLength[Previous];
+			return HistoryDepth[Previous] == BACKGROUND;
+		}
+
+		const vec3 Point = View.Position + VecUtils::normalize(View.PixelDirection(x + Jitter.x, y + Jitter.y)) * Depth;
+		if (!PreviousView.Project(Point, PreviousPos))
+			return false;
+		const float px = PreviousPos.x;
+		const float py = PreviousPos.y;
+		const int x0 = static_cast<int>(std::floor(px));
+		const int y0 = static_cast<int>(std::floor(py));
+		const float fx = px - x0;
+		const float fy = py - y0;
+		const float Expected = VecUtils::distance(Point, PreviousView.Position);
+
+		const bool Silhouette = OnSilhouette(x, y, Depth);
+
+		// Catmull-Rom weights along each axis, which blur the history far less than bilinear filtering when
+		// it is resampled frame after frame
+		auto CatmullRom = [](float t, float (&Weights)[4])
+		{
+			const float t2 = t * t;
+			const float t3 = t2 * t;
+			Weights[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+			Weights[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+			Weights[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+			Weights[3] = 0.5f * (t3 - t2);
+		};
+		float WeightsX[4];
+		float WeightsY[4];
+		CatmullRom(fx, WeightsX);
+		CatmullRom(fy, WeightsY);
+
+		color4 Sum = color4(0, 0, 0, 0);
+		float WeightSum = 0.0f;
+		float LengthSum = 0.0f;
+		for (int ty = 0; ty < 4; ty++)
+		{
+			for (int tx = 0; tx < 4; tx++)
+			{
+				const int hx = x0 - 1 + tx;
+				const int hy = y0 - 1 + ty;
+				if (hx < 0 || hy < 0 || hx >= Width || hy >= Height)
+					continue;
+				const size_t Previous = size_t(hy) * Width + hx;
+				if (!Silhouette && !DepthMatches(HistoryDepth[Previous], Expected))
+					continue;
+				const float Weight = WeightsX[tx] * WeightsY[ty];
+				Sum = Sum + History[Previous] * Weight;
+				LengthSum += HistoryLength[Previous] * Weight;
+				WeightSum += Weight;
+			}
+		}
+		if (WeightSum < 0.5f)
+			return false;
+		Color = Sum * (1.0f / WeightSum);
+		Length = std::max(static_cast<int>(LengthSum / WeightSum + 0.5f), 1);
+		return true;
+	};
+
+	const size_t Ranges = Parallel::RangeCount(Height, 16);
+	std::vector<uint64_t> RangeReused(Ranges, 0);
+	std::vector<uint64_t> RangeLength(Ranges, 0);
+	Parallel::ForRanges(Height, Ranges, [&](size_t Begin, size_t End, size_t Range)
+	{
+		for (int y = static_cast<int>(Begin); y < static_cast<int>(End); y++)
+		{
+			for (int x = 0; x < Width; x++)
+			{
+				const size_t i = size_t(y) * Width + x;
+				color4 Past;
+				int Length;
+				if (!Reproject(x, y, Past, Length))
+				{
+					Blended[i] = Frame.Pixels[i];
+					BlendedLength[i] = 1;
+				}
+				else
+				{
+					// A running average over the last Length frames, the newest weighing 1 / Length
+					Length = std::min(Length + 1, MaxLength);
+					Past = ClampToNeighbours(Frame, x, y, Past, Moved ? 1.0f : 2.0f);
+					Blended[i] = Past + (Frame.Pixels[i] - Past) * (1.0f / Length);
+					BlendedLength[i] = static_cast<uint16_t>(Length);
+					RangeReused[Range]++;
+				}
+				RangeLength[Range] += BlendedLength[i];
+			}
+		}
+	});
+
+	History.swap(Blended);
+	HistoryLength.swap(BlendedLength);
+	HistoryDepth = Frame.Depth;
+	std::copy(History.begin(), History.end(), Frame.Pixels.begin());
+	PreviousView = View;
+	FrameIndex++;
+
+	TemporalStats Stats;
+	uint64_t Reused = 0;
+	uint64_t Length = 0;
+	for (size_t Range = 0; Range < Ranges; Range++)
+	{
+		Reused += RangeReused[Range];
+		Length += RangeLength[Range];
+	}
+	Stats.ReusedPixels = static_cast<double>(Reused) / PixelCount;
+	Stats.AverageHistory = static_cast<double>(Length) / PixelCount;
+	return Stats;
+}
+
+void TemporalAccumulator::Reset()
+{
+	History.clear();
+	FrameIndex = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Raytracer.hpp"
+#include "Rendering.hpp"
+
+// What blending a frame into the history did
+struct TemporalStats
+{
+	// Share of pixels that kept some of their history
+	double ReusedPixels = 0.0;
+	// Frames averaged per pixel
+	double AverageHistory = 0.0;
+};
+
+// Blends the viewer's frames over time; while the camera stays still every pixel converges to the average of its
+// jittered samples, and when it moves the history is reprojected through the stored depth of the new frame
+// History that no longer matches is dropped: where the depth it was stored with disagrees with the reprojected
+// point, or with the pixel's own depth while the camera stays still, and, to a lesser degree, where its color falls
+// outside the range of the pixel's neighbours this frame
+class TemporalAccumulator
+{
+public:
+	// Sub-pixel offset to render the next frame with; scrambled Sobol points, so any run of frames covers the pixel evenly
+	vec2 NextJitter() const;
+
+	// Blends Frame, rendered by View with Jitter, into the history, and replaces its pixels with the result
+	// Frame.Depth has to be filled in; starts over on its own when the frame size changes
+	TemporalStats Accumulate(const TemporalSettings& Settings, const Camera& View, vec2 Jitter, Framebuffer& Frame);
+
+	void Reset();
+
+private:
+	std::vector<color4> History{};
+	std::vector<float> HistoryDepth{};
+	std::vector<uint16_t> HistoryLength{};
+	// Scratch for the blended frame, kept to avoid reallocating every frame
+	std::vector<color4> Blended{};
+	std::vector<uint16_t> BlendedLength{};
+	Camera PreviousView{};
+	uint32_t FrameIndex = 0;
+};
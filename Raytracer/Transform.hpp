@@ -0,0 +1,96 @@
+#pragma once
+#include <cmath>
+#include <numbers>
+
+#include "VecUtils.hpp"
+
+// Affine transform; a 3x3 linear part stored as rows, followed by a translation
+struct Transform
+{
+    vec3 Rows[3] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) };
+    vec3 Translation = vec3(0, 0, 0);
+
+    vec3 TransformPoint(const vec3& p) const
+    {
+        return TransformVector(p) + Translation;
+    }
+
+    // Ignores the translation
+    vec3 TransformVector(const vec3& v) const
+    {
+        return vec3(VecUtils::dot(Rows[0], v), VecUtils::dot(Rows[1], v), VecUtils::dot(Rows[2], v));
+    }
+
+    // Multiplies by the transpose of the linear part
+    // Applied with the inverse transform, this takes normals from object space to world space
+    vec3 TransformTransposed(const vec3& v) const
+    {
+        return Rows[0] * v.x + Rows[1] * v.y + Rows[2] * v.z;
+    }
+
+    // Applies Other first, then this
+    Transform operator*(const Transform& Other) const
+    {
+        Transform Result;
+        for (int i = 0; i < 3; i++)
+            Result.Rows[i] = Other.TransformTransposed(Rows[i]);
+        Result.Translation = TransformPoint(Other.Translation);
+        return Result;
+    }
+
+    // Expects the linear part to be invertible
+    Transform Inverse() const
+    {
+        // Columns of the inverse are the cross products of the rows, over the determinant
+        const vec3 c0 = VecUtils::cross(Rows[1], Rows[2]);
+        const vec3 c1 = VecUtils::cross(Rows[2], Rows[0]);
+        const vec3 c2 = VecUtils::cross(Rows[0], Rows[1]);
+        const float InvDeterminant = 1.0f / VecUtils::dot(Rows[0], c0);
+
+        Transform Result;
+        for (int i = 0; i < 3; i++)
+            Result.Rows[i] = vec3(c0[i], c1[i], c2[i]) * InvDeterminant;
+        Result.Translation = -Result.TransformVector(Translation);
+        return Result;
+    }
+
+    static Transform Translate(const vec3& Offset)
+    {
+        Transform Result;
+        Result.Translation = Offset;
+        return Result;
+    }
+
+    static Transform Scale(const vec3& Factors)
+    {
+        Transform Result;
+        for (int i = 0; i < 3; i++)
+            Result.Rows[i][i] = Factors[i];
+        return Result;
+    }
+
+    // Rotation of Degrees around the given axis (0 = x, 1 = y, 2 = z)
+    static Transform Rotate(int Axis, float Degrees)
+    {
+        const float Radians = Degrees * std::numbers::pi_v<float> / 180.0f;
+        const float c = std::cos(Radians);
+        const float s = std::sin(Radians);
+        const int a = (Axis + 1) % 3;
+        const int b = (Axis + 2) % 3;
+
+        Transform Result;
+        Result.Rows[a][a] = c;
+        Result.Rows[a][b] = -s;
+        Result.Rows[b][a] = s;
+        Result.Rows[b][b] = c;
+        return Result;
+    }
+
+    // Scaled, then rotated around x, y and z in that order (in degrees), then moved to Position
+    static Transform Place(const vec3& Position, const vec3& Rotation, float UniformScale)
+    {
+        return Translate(Position)
+            * Rotate(2, Rotation.z) * Rotate(1, Rotation.y) * Rotate(0, Rotation.x)
+            * Scale(vec3(UniformScale, UniformScale, UniformScale));
+    }
+};
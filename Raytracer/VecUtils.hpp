@@ -1,4 +1,5 @@
 #pragma once
+#include <cmath>
 #include <string>
 #include <sstream>
 
@@ -256,8 +257,28 @@ namespace VecUtils
         return result;
     }
 
+    // Component-wise minimum
+    template <VecType Vec>
+    Vec min(const Vec& a, const Vec& b)
+    {
+        Vec result{};
+        for (size_t i = 0; i < sizeof(Vec) / sizeof(decltype(a.x)); ++i)
+            result[i] = a[i] < b[i] ? a[i] : b[i];
+        return result;
+    }
+
+    // Component-wise maximum
+    template <VecType Vec>
+    Vec max(const Vec& a, const Vec& b)
+    {
+        Vec result{};
+        for (size_t i = 0; i < sizeof(Vec) / sizeof(decltype(a.x)); ++i)
+            result[i] = a[i] > b[i] ? a[i] : b[i];
+        return result;
+    }
+
     // Cross product
-    template <VecType T>
+    template <typename T>
     vec<T, 3> cross(const vec<T, 3>& a, const vec<T, 3>& b)
     {
         return vec<T, 3>{
@@ -1,13 +1,50 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <chrono>
+#include <string>
+#include <string_view>
 
 #include <SDL3/SDL.h>
 
+#include "Batch.hpp"
+#include "Benchmark.hpp"
+#include "Checkerboard.hpp"
+#include "Denoiser.hpp"
 #include "Drawing.hpp"
+#include "ImageWriter.hpp"
+#include "PathTracer.hpp"
 #include "Raytracer.hpp"
+#include "Rendering.hpp"
+#include "SceneLoader.hpp"
+#include "Temporal.hpp"
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string_view(argv[1]) == "--bench")
+        return Benchmark::RunAll(argc > 2 ? argv[2] : "");
+    // Headless animation rendering: --render <scene> <output prefix> [first frame] [last frame]
+    if (argc > 3 && std::string_view(argv[1]) == "--render")
+        return Batch::Run(argv[2], argv[3], argc > 4 ? std::atoi(argv[4]) : 0, argc > 5 ? std::atoi(argv[5]) : -1);
+
+    // Create scene; either from the given scene file or the built-in demo
+    Scene Scene;
+    if (argc > 1) {
+        if (!SceneLoader::LoadScene(argv[1], Scene))
+            return 1;
+    }
+    else {
+        Scene.AddSphere(vec3(0, -1, 4), 1, Colors::Red, 100, 0.1f);
+        Scene.AddSphere(vec3(2, 0, 5), 1, Colors::Blue, 1000, 0.5f);
+        Scene.AddSphere(vec3(-2, 0, 5), 1, Colors::Green, 10, 0.2f);
+        Scene.AddPlane(vec3(0, -1, 0), vec3(0, 1, 0), Colors::Yellow, 10, 0.1f);
+        Scene.AddAmbientLight(0.2f);
+        Scene.AddPointLight(2.5f, vec3(2, 1, 0));
+        Scene.AntiAliasing.EdgeSamples = 16;
+    }
+    Raytracer::PrintSceneStats(Scene);
+
     // SDL Setup
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         std::cerr << "SDL_Init Error: " << SDL_GetError() << "\n";
@@ -23,44 +60,184 @@ int main(int argc, char* argv[]) {
     SDL_Renderer* Renderer = SDL_CreateRenderer(Window, nullptr);
     SDL_SetRenderDrawColor(Renderer, 0, 0, 0, 255);
 
-    // Create scene
-    Scene Scene;
-    Scene.AddSphere(vec3(0, -1, 4), 1, Colors::Red, 100, 0.1f);
-    Scene.AddSphere(vec3(2, 0, 5), 1, Colors::Blue, 1000, 0.5f);
-    Scene.AddSphere(vec3(-2, 0, 5), 1, Colors::Green, 10, 0.2f);
-    Scene.AddSphere(vec3(0, -1001, 0), 1000, Colors::Yellow, 10, 0.1f);
-    Scene.AddAmbientLight(0.2f);
-    Scene.AddPointLight(2.5f, vec3(2, 1, 0));
-
-    // Main loop
+    // Main loop; frames are only rendered when something changed, or while the image is still converging
+    Framebuffer Frame;
+    PathTracer Tracer;
+    TemporalAccumulator Temporal;
+    CheckerboardReconstructor Checkerboard;
+    Denoiser Filter;
+    ImageWriter Screenshots;
+    int ScreenshotCount = 0;
     bool Running = true;
+    bool Changed = true;
+    int FramesSinceChange = 0;
+    bool Playing = !Scene.Animation.Empty();
+    float AnimationTime = 0.0f;
+    const bool* Keys = SDL_GetKeyboardState(nullptr);
+    auto LastFrameTime = std::chrono::high_resolution_clock::now();
     SDL_Event e;
     while (Running) {
+        // WASD moves, Q and E go down and up, the arrow keys or dragging with the right mouse button turn,
+        // shift speeds it all up and the mouse wheel zooms
+        const bool Navigating = Keys[SDL_SCANCODE_W] || Keys[SDL_SCANCODE_A] || Keys[SDL_SCANCODE_S] || Keys[SDL_SCANCODE_D]
+            || Keys[SDL_SCANCODE_Q] || Keys[SDL_SCANCODE_E] || Keys[SDL_SCANCODE_LEFT] || Keys[SDL_SCANCODE_RIGHT]
+            || Keys[SDL_SCANCODE_UP] || Keys[SDL_SCANCODE_DOWN];
+        const bool Converging = Scene.PathTracing.Enabled
+            || (Scene.Temporal.Enabled && FramesSinceChange < Scene.Temporal.MaxHistory)
+            || (Scene.Checkerboard.Enabled && FramesSinceChange < 2);
+        // Sleeps until there is input once the image is finished
+        if (!Changed && !Navigating && !Converging && !Playing)
+            SDL_WaitEvent(nullptr);
+
+        const Camera Before = Scene.Camera;
         while (SDL_PollEvent(&e)) {
             if (e.type == SDL_EVENT_QUIT)
                 Running = false;
+            // C switches checkerboard rendering on and off
+            else if (e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_C && !e.key.repeat) {
+                Scene.Checkerboard.Enabled = !Scene.Checkerboard.Enabled;
+                Checkerboard.Reset();
+                Changed = true;
+            }
+            // Space pauses and resumes the animation
+            else if (e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_SPACE && !e.key.repeat)
+                Playing = !Playing && !Scene.Animation.Empty();
+            // P saves the frame as shown to a PNG, shift P the rendered values to a half float EXR; both are
+            // written in the background
+            else if (e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_P && !e.key.repeat && !Frame.Pixels.empty()) {
+                const bool Exr = (e.key.mod & SDL_KMOD_SHIFT) != 0;
+                const std::string Path = "screenshot" + std::to_string(ScreenshotCount++) + (Exr ? ".exr" : ".png");
+                Screenshots.Write(Frame.Pixels, Frame.Width, Frame.Height, Path, Exr ? ImageFormat::EXR : ImageFormat::PNG);
+                std::cout << "Saving " << Path << std::endl;
+            }
+            // R switches the full quality region on and off
+            else if (e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_R && !e.key.repeat) {
+                Scene.Region.Enabled = !Scene.Region.Enabled;
+                Changed = true;
+            }
+            else if (e.type == SDL_EVENT_MOUSE_MOTION) {
+                if (e.motion.state & SDL_BUTTON_RMASK) {
+                    Scene.Camera.Yaw += 0.2f * e.motion.xrel;
+                    Scene.Camera.Pitch = std::clamp(Scene.Camera.Pitch - 0.2f * e.motion.yrel, -89.0f, 89.0f);
+                }
+                // The region follows the mouse, centered on it
+                if (Scene.Region.Enabled && Scene.Region.FollowMouse) {
+                    float x, y;
+                    SDL_RenderCoordinatesFromWindow(Renderer, e.motion.x, e.motion.y, &x, &y);
+                    Scene.Region.Left = static_cast<int>(x) - Scene.Region.Width / 2;
+                    Scene.Region.Top = static_cast<int>(y) - Scene.Region.Height / 2;
+                    Changed = true;
+                }
+            }
+            else if (e.type == SDL_EVENT_MOUSE_WHEEL)
+                Scene.Camera.FieldOfView = std::clamp(Scene.Camera.FieldOfView - 2.0f * e.wheel.y, 10.0f, 120.0f);
+            // The window has to be drawn again after being resized or uncovered
+            else if (e.type == SDL_EVENT_WINDOW_EXPOSED || e.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED)
+                Changed = true;
+        }
+
+        // Keyboard navigation, scaled by the time since the last frame; capped so a long wait doesn't jump
+        const auto FrameTime = std::chrono::high_resolution_clock::now();
+        const float Seconds = std::min(std::chrono::duration<float>(FrameTime - LastFrameTime).count(), 0.1f);
+        LastFrameTime = FrameTime;
+        const float Speed = (Keys[SDL_SCANCODE_LSHIFT] || Keys[SDL_SCANCODE_RSHIFT] ? 8.0f : 2.0f) * Seconds;
+        const float TurnSpeed = (Keys[SDL_SCANCODE_LSHIFT] || Keys[SDL_SCANCODE_RSHIFT] ? 180.0f : 60.0f) * Seconds;
+        const vec3 Forward = Scene.Camera.Forward();
+        const vec3 Right = Scene.Camera.Right();
+        const vec3 Up = vec3(0, 1, 0);
+        Scene.Camera.Position = Scene.Camera.Position
+            + Forward * (Speed * (Keys[SDL_SCANCODE_W] - Keys[SDL_SCANCODE_S]))
+            + Right * (Speed * (Keys[SDL_SCANCODE_D] - Keys[SDL_SCANCODE_A]))
+            + Up * (Speed * (Keys[SDL_SCANCODE_E] - Keys[SDL_SCANCODE_Q]));
+        Scene.Camera.Yaw += TurnSpeed * (Keys[SDL_SCANCODE_RIGHT] - Keys[SDL_SCANCODE_LEFT]);
+        Scene.Camera.Pitch = std::clamp(Scene.Camera.Pitch + TurnSpeed * (Keys[SDL_SCANCODE_UP] - Keys[SDL_SCANCODE_DOWN]), -89.0f, 89.0f);
+
+        // Animated scenes play on a loop, overriding navigation if the camera has keyframes
+        if (Playing) {
+            AnimationTime = std::fmod(AnimationTime + Seconds, Scene.Animation.Duration());
+            Scene.Animation.Apply(AnimationTime, Scene);
+            Tracer.Reset();
+            // Temporal and checkerboard history only follow the camera, so moving objects and lights would ghost
+            if (Scene.Animation.MovesObjects()) {
+                Temporal.Reset();
+                Checkerboard.Reset();
+            }
+            Changed = true;
         }
 
+        // The path tracer starts over from a new viewpoint; temporal accumulation and checkerboard frames reproject
+        if (!(Scene.Camera == Before)) {
+            Tracer.Reset();
+            Changed = true;
+        }
+        if (Changed)
+            FramesSinceChange = 0;
+        else if (!Converging)
+            continue;
+        Changed = false;
+        FramesSinceChange++;
+
         SDL_SetRenderDrawColor(Renderer, 0, 0, 0, 255);
         SDL_RenderClear(Renderer);
 
         auto StartTime = std::chrono::high_resolution_clock::now();
+        Scene.UpdateAcceleration();
+        auto TraceStartTime = std::chrono::high_resolution_clock::now();
         
-        // Rendering
-        #pragma omp for
-        for (int x = -Drawing::ResX / 2; x < Drawing::ResX / 2; x++) 
-        {
-            for (int y = -Drawing::ResY / 2; y < Drawing::ResY / 2; y++) 
-            {
-                Ray R = Ray(Scene.Origin, Drawing::CanvasToViewport(ivec2(x, y)));
-                RayPayload Result = Raytracer::TraceRay(Scene, R);
-                Drawing::DrawPixel(Renderer, x + Drawing::ResX / 2, y + Drawing::ResY / 2, Result.Color);
+        // Rendering; the path tracer refines the same image every frame, and so does temporal accumulation
+        // while the camera stays still. Checkerboard frames trace half the pixels and fill in the rest
+        FrameStats Stats;
+        TemporalStats History;
+        CheckerboardStats Filled;
+        double ReconstructMs = 0.0;
+        if (Scene.PathTracing.Enabled)
+            Stats = Tracer.RenderPass(Scene, Frame);
+        else {
+            const vec2 Jitter = Scene.Temporal.Enabled ? Temporal.NextJitter() : vec2(0, 0);
+            const PixelSet Pixels = Scene.Checkerboard.Enabled ? Checkerboard.NextPixels() : PixelSet::All;
+            Stats = Rendering::Render(Scene, Frame, Jitter, Pixels);
+            if (Scene.Checkerboard.Enabled) {
+                auto ReconstructStartTime = std::chrono::high_resolution_clock::now();
+                Filled = Checkerboard.Reconstruct(Scene.Checkerboard, Scene.Camera, Pixels, Frame);
+                ReconstructMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - ReconstructStartTime).count();
             }
+            if (Scene.Temporal.Enabled)
+                History = Temporal.Accumulate(Scene.Temporal, Scene.Camera, Jitter, Frame);
+        }
+        // Denoising only changes what is shown; the path tracer keeps averaging its own noisy passes
+        double DenoiseMs = 0.0;
+        if (Scene.Denoise.Enabled) {
+            auto DenoiseStartTime = std::chrono::high_resolution_clock::now();
+            Filter.Apply(Scene.Denoise, Frame);
+            DenoiseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - DenoiseStartTime).count();
+        }
+        for (int y = 0; y < Frame.Height; y++)
+        {
+            for (int x = 0; x < Frame.Width; x++)
+                Drawing::DrawPixel(Renderer, x, y, Frame.At(x, y));
         }
 
         auto StopTime = std::chrono::high_resolution_clock::now();
         auto Duration = std::chrono::duration_cast<std::chrono::milliseconds>(StopTime - StartTime);
-        std::cout << "Rendered in " << Duration.count() << " ms." << std::endl;
+        auto TraceDuration = std::chrono::duration_cast<std::chrono::milliseconds>(StopTime - TraceStartTime);
+        std::cout << "Rendered in " << Duration.count() << " ms (trace " << TraceDuration.count()
+            << " ms, BVH build " << Scene.LastUpdate.BuildMs << " ms x" << Scene.LastUpdate.Rebuilds
+            << ", refit " << Scene.LastUpdate.RefitMs << " ms x" << Scene.LastUpdate.Refits << ")"
+            << ", " << Stats.SamplesPerPixel << " samples per pixel"
+            << ", lights per pixel " << Stats.LightsPerPixel << " (max " << Stats.MaxPixelLights << ")";
+        if (Scene.PathTracing.Enabled)
+            std::cout << ", pass " << Tracer.PassCount() << " with " << Stats.BouncesPerSample << " bounces per path";
+        if (Scene.Temporal.Enabled && !Scene.PathTracing.Enabled)
+            std::cout << ", " << History.AverageHistory << " frames of history (" << 100.0 * History.ReusedPixels << "% reused)";
+        if (Scene.Checkerboard.Enabled && !Scene.PathTracing.Enabled)
+            std::cout << ", checkerboard " << 100.0 * Filled.TracedPixels << "% traced, " << 100.0 * Filled.ReusedPixels
+                << "% reused, " << 100.0 * Filled.InterpolatedPixels << "% interpolated in " << ReconstructMs << " ms";
+        if (Scene.Denoise.Enabled)
+            std::cout << ", denoised in " << DenoiseMs << " ms";
+        const ShadowCacheStats ShadowStats = Scene.Shadows.Stats();
+        if (Scene.CacheShadows && ShadowStats.Lookups > 0)
+            std::cout << ", shadow cache hit rate " << 100.0 * ShadowStats.Hits / ShadowStats.Lookups << "%";
+        std::cout << "." << std::endl;
 
         SDL_RenderPresent(Renderer);
     }